@@ -0,0 +1,36 @@
+#!/bin/bash
+# Batch mode throughput. Generates a script of built in, comment and blank
+# lines (no process launches, so the shell's own per line cost is what is
+# measured) and runs it through smallsh twice: as a script argument, which
+# is mapped, and piped on stdin. Prints one JSON object per run.
+#
+#   bench/batch_bench.sh [smallsh] [lines]
+
+SMALLSH=${1:-./smallsh}
+LINES=${2:-100000}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+for ((x = 0; x < LINES / 4; x++)); do
+    printf '# step %d of $$\ncd .\nstatus\n\n' "$x"
+done > "$SCRIPT"
+echo exit >> "$SCRIPT"
+
+run() {
+    local mode=$1
+    local start end
+    start=$(date +%s%N)
+    if [ "$mode" = script ]; then
+        "$SMALLSH" "$SCRIPT" > /dev/null
+    else
+        cat "$SCRIPT" | "$SMALLSH" > /dev/null
+    fi
+    end=$(date +%s%N)
+    awk -v mode="$mode" -v lines="$LINES" -v ns=$((end - start)) 'BEGIN {
+        printf "{\"bench\":\"batch\",\"input\":\"%s\",\"lines\":%d,\"seconds\":%.3f,\"lines_per_s\":%.0f}\n",
+               mode, lines, ns / 1e9, lines / (ns / 1e9)
+    }'
+}
+
+run script
+run stdin
@@ -0,0 +1,99 @@
+/***************************************************************************
+*   Description -
+*       Parser microbenchmark. Times parseBuffer() ($$ expansion, word 
+*       splitting and classification) on two worst case lines:
+*           2048-char   - one 2048 character line of short words with $$
+*           512-arg     - a command followed by 512 arguements
+*       Each is run through parseBuffer() and again through the parsed 
+*       line cache (-cached), where every line after the second is a hit.
+*       Prints one JSON object per case.
+*
+*       gcc -O2 -o parse_bench bench/parse_bench.c
+*       ./parse_bench [iterations]
+****************************************************************************/
+#define main smallshMain
+#include "../main.c"
+#undef main
+
+#include <time.h>
+
+double benchNow(void)
+/***************************************************************************
+*   Description -
+*       Monotonic clock in nanoseconds
+****************************************************************************/
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+void benchLine(const char *name, const char *line, long iterations,
+               struct command *(*parse)(const char *, size_t, struct arena *))
+/***************************************************************************
+*   Description -
+*       Parses line repeatedly from a resettable arena, with parseBuffer()
+*       or through the line cache (cachedParse), and reports the mean 
+*       cost per line
+****************************************************************************/
+{
+    struct arena lineArena = {0};
+    size_t length = strlen(line);
+    int words = 0;
+
+    // Warm the arena so its block is sized for this line
+    for(long x = 0; x < 1000; x++)
+    {
+        arenaReset(&lineArena);
+        parse(line, length, &lineArena);
+    }
+
+    double start = benchNow();
+    for(long x = 0; x < iterations; x++)
+    {
+        arenaReset(&lineArena);
+        struct command *parsed = parse(line, length, &lineArena);
+        words += parsed->arguements[0] != NULL;
+    }
+    double elapsed = benchNow() - start;
+
+    printf("{\"bench\":\"parse\",\"case\":\"%s\",\"bytes\":%zu,\"iterations\":%ld,"
+           "\"ns_per_line\":%.1f,\"mb_per_s\":%.1f,\"check\":%d}\n",
+           name, length, iterations, elapsed / iterations,
+           (length * (double)iterations) / (elapsed / 1e9) / 1e6, words > 0);
+    free(lineArena.block);
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    pidLength = snprintf(pidString, sizeof(pidString), "%d", getpid());
+
+    // 2048 characters: "echo" then words like "a$$b" up to the limit
+    char longLine[2049];
+    int used = snprintf(longLine, sizeof(longLine), "echo");
+    while(used + 6 <= 2048)
+    {
+        used += snprintf(longLine + used, sizeof(longLine) - used, " a$$bc");
+    }
+    while(used < 2048)
+    {
+        longLine[used++] = 'x';
+    }
+    longLine[used] = '\0';
+
+    // 512 arguements plus redirections and a trailing &
+    char argLine[8192];
+    used = snprintf(argLine, sizeof(argLine), "ls");
+    for(int x = 0; x < 512; x++)
+    {
+        used += snprintf(argLine + used, sizeof(argLine) - used, " arg%d", x);
+    }
+    snprintf(argLine + used, sizeof(argLine) - used, " < in > out &");
+
+    benchLine("2048-char", longLine, iterations, parseBuffer);
+    benchLine("512-arg", argLine, iterations, parseBuffer);
+    benchLine("2048-char-cached", longLine, iterations, cachedParse);
+    benchLine("512-arg-cached", argLine, iterations, cachedParse);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/bash
+# Long run memory check. Feeds 1M lines to smallsh in batch mode, built in,
+# comment and blank lines that are all different (so none are repeats of
+# a cached parse), and reads the shell's peak RSS (VmHWM) after 100k and
+# after 1M lines. Per line state comes from the arena and the caches are
+# bounded, so the peak must not grow by more than BOUND kB in between.
+# Prints one JSON object and exits non-zero past the bound.
+#
+#   bench/rss_check.sh [smallsh] [bound kB]
+
+SMALLSH=${1:-./smallsh}
+BOUND=${2:-512}
+
+# 100k lines, every one different from the lines of the other blocks
+block() {
+    awk -v block="$1" 'BEGIN {
+        for(x = 0; x < 25000; x++) {
+            printf "true block%d line%d $$ a b c d e f g h\n", block, x
+            printf "# comment %d %d $$\n", block, x
+            printf "cd .\n\n"
+        }
+    }'
+}
+
+coproc SHELL_UNDER_TEST { exec "$SMALLSH" 2>&1; }
+PID=$SHELL_UNDER_TEST_PID
+
+# Waits until the lines written so far have run, then sets PEAK to the
+# shell's peak RSS. The mark is an external echo, the shell's own stdout
+# is buffered
+peak() {
+    echo "/bin/echo mark $1" >&"${SHELL_UNDER_TEST[1]}"
+    local line
+    while read -r line <&"${SHELL_UNDER_TEST[0]}"; do
+        [ "$line" = "mark $1" ] && break
+    done
+    PEAK=$(awk '/^VmHWM:/ { print $2 }' "/proc/$PID/status")
+}
+
+block 0 >&"${SHELL_UNDER_TEST[1]}"
+peak 100000
+EARLY=$PEAK
+for ((x = 1; x < 10; x++)); do
+    block $x >&"${SHELL_UNDER_TEST[1]}"
+done
+peak 1000000
+LATE=$PEAK
+echo exit >&"${SHELL_UNDER_TEST[1]}"
+wait "$PID"
+
+GROWTH=$((LATE - EARLY))
+printf '{"bench":"rss","lines":1000000,"hwm_100k_kb":%d,"hwm_1m_kb":%d,"growth_kb":%d,"bound_kb":%d}\n' \
+       "$EARLY" "$LATE" "$GROWTH" "$BOUND"
+[ "$GROWTH" -le "$BOUND" ]
@@ -0,0 +1,267 @@
+/***************************************************************************
+*   Description -
+*       End to end benchmark of the shell's hot paths. Drives one
+*       'smallsh -i' over pipes and times each operation from the moment
+*       its lines are written until the shell has answered. Every
+*       operation ends with a status built in, so "exit value" in the
+*       output marks it as done no matter what else is printed.
+*
+*       Scenarios
+*           parse       - status with 128 arguements and $$ (no launch)
+*           spawn       - /bin/true, one foreground launch (true is
+*                         run natively by the shell)
+*           fanout      - N 'true &' background jobs, then wait
+*           redirect    - cat < input > output
+*
+*       Prints one JSON object per scenario with ops/sec and p50/p99
+*       latency, plus the shell's peak RSS at the end.
+*
+*       gcc -O2 -o shellbench bench/shellbench.c
+*       ./shellbench [smallsh] [scale] [fanout]
+****************************************************************************/
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Pipes to and from the shell under test
+int toShell = -1;
+int fromShell = -1;
+pid_t shellPid = -1;
+
+double benchNow(void)
+/***************************************************************************
+*   Description -
+*       Monotonic clock in microseconds
+****************************************************************************/
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+void startShell(const char *smallsh)
+/***************************************************************************
+*   Description -
+*       Starts 'smallsh -i' with its stdin and stdout connected to us
+****************************************************************************/
+{
+    int input[2];
+    int output[2];
+    if(pipe2(input, O_CLOEXEC) == -1 || pipe2(output, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, output[1], 1);
+    char *argv[] = {(char *)smallsh, "-i", NULL};
+    if(posix_spawn(&shellPid, smallsh, &actions, NULL, argv, environ) != 0)
+    {
+        perror(smallsh);
+        exit(1);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(input[0]);
+    close(output[1]);
+    toShell = input[1];
+    fromShell = output[0];
+}
+
+void writeAll(const char *text, size_t length)
+/***************************************************************************
+*   Description -
+*       Writes the whole of text to the shell
+****************************************************************************/
+{
+    while(length > 0)
+    {
+        ssize_t count = write(toShell, text, length);
+        if(count <= 0)
+        {
+            perror("write");
+            exit(1);
+        }
+        text += count;
+        length -= count;
+    }
+}
+
+void awaitMarks(int marks)
+/***************************************************************************
+*   Description -
+*       Reads shell output until "exit value" has been seen marks times.
+*       A few bytes are carried over so a mark split across two reads
+*       still counts.
+****************************************************************************/
+{
+    static const char mark[] = "exit value";
+    char buffer[65536 + sizeof(mark)];
+    size_t carry = 0;
+    while(marks > 0)
+    {
+        ssize_t count = read(fromShell, buffer + carry, 65536);
+        if(count <= 0)
+        {
+            fprintf(stderr, "shell closed its output\n");
+            exit(1);
+        }
+        size_t length = carry + count;
+        char *scan = buffer;
+        char *found;
+        while(marks > 0 && (found = memmem(scan, buffer + length - scan, mark, sizeof(mark) - 1)) != NULL)
+        {
+            marks --;
+            scan = found + sizeof(mark) - 1;
+        }
+        carry = length - (scan - buffer) < sizeof(mark) - 1 ? length - (scan - buffer) : sizeof(mark) - 1;
+        memmove(buffer, buffer + length - carry, carry);
+    }
+}
+
+int compareDouble(const void *left, const void *right)
+/***************************************************************************
+*   Description -
+*       qsort() order for latencies
+****************************************************************************/
+{
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+    return (a > b) - (a < b);
+}
+
+void scenario(const char *name, const char *text, int ops)
+/***************************************************************************
+*   Description -
+*       Runs text (ending in a status line) ops times, one at a time, and
+*       reports throughput and latency percentiles
+****************************************************************************/
+{
+    double *latency = malloc(ops * sizeof(double));
+    size_t length = strlen(text);
+
+    // Warm up the PATH table, page cache and allocator
+    for(int x = 0; x < ops / 20 + 1; x++)
+    {
+        writeAll(text, length);
+        awaitMarks(1);
+    }
+
+    double start = benchNow();
+    for(int x = 0; x < ops; x++)
+    {
+        double begin = benchNow();
+        writeAll(text, length);
+        awaitMarks(1);
+        latency[x] = benchNow() - begin;
+    }
+    double elapsed = benchNow() - start;
+
+    qsort(latency, ops, sizeof(double), compareDouble);
+    printf("{\"bench\":\"shell\",\"scenario\":\"%s\",\"ops\":%d,\"ops_per_s\":%.1f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+           name, ops, ops / (elapsed / 1e6), latency[ops / 2],
+           latency[(int)(ops * 0.99)], latency[ops - 1]);
+    fflush(stdout);
+    free(latency);
+}
+
+long shellPeakRSS(void)
+/***************************************************************************
+*   Description -
+*       Peak resident set of the shell in kB, from /proc
+****************************************************************************/
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", shellPid);
+    FILE *status = fopen(path, "r");
+    if(status == NULL)
+    {
+        return -1;
+    }
+    char line[256];
+    long peak = -1;
+    while(fgets(line, sizeof(line), status) != NULL)
+    {
+        if(strncmp(line, "VmHWM:", 6) == 0)
+        {
+            peak = atol(line + 6);
+        }
+    }
+    fclose(status);
+    return peak;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *smallsh = argc > 1 ? argv[1] : "./smallsh";
+    int scale = argc > 2 ? atoi(argv[2]) : 1;
+    int fanout = argc > 3 ? atoi(argv[3]) : 16;
+    if(scale < 1)
+    {
+        scale = 1;
+    }
+
+    char input[] = "/tmp/shellbench.in.XXXXXX";
+    int inputFD = mkstemp(input);
+    for(int x = 0; x < 256; x++)
+    {
+        dprintf(inputFD, "line %d of the redirection input\n", x);
+    }
+    close(inputFD);
+    char output[sizeof(input) + 4];
+    snprintf(output, sizeof(output), "%s.out", input);
+
+    // History stays on, as it would be for a user, but out of ~
+    char history[sizeof(input) + 5];
+    snprintf(history, sizeof(history), "%s.hist", input);
+    setenv("HISTFILE", history, 1);
+
+    startShell(smallsh);
+
+    char parseLine[4096];
+    int used = snprintf(parseLine, sizeof(parseLine), "status");
+    for(int x = 0; x < 128; x++)
+    {
+        used += snprintf(parseLine + used, sizeof(parseLine) - used, " arg%d-$$", x);
+    }
+    snprintf(parseLine + used, sizeof(parseLine) - used, "\n");
+    scenario("parse", parseLine, 20000 * scale);
+
+    scenario("spawn", "/bin/true\nstatus\n", 1000 * scale);
+
+    char *fanLines = malloc(fanout * 8 + 32);
+    fanLines[0] = '\0';
+    for(int x = 0; x < fanout; x++)
+    {
+        strcat(fanLines, "true &\n");
+    }
+    strcat(fanLines, "wait\nstatus\n");
+    scenario("fanout", fanLines, 50 * scale);
+    free(fanLines);
+
+    char redirectLine[256];
+    snprintf(redirectLine, sizeof(redirectLine), "cat < %s > %s\nstatus\n", input, output);
+    scenario("redirect", redirectLine, 1000 * scale);
+
+    printf("{\"bench\":\"shell\",\"scenario\":\"memory\",\"max_rss_kb\":%ld}\n", shellPeakRSS());
+
+    writeAll("exit\n", 5);
+    close(toShell);
+    waitpid(shellPid, NULL, 0);
+    unlink(input);
+    unlink(output);
+    unlink(history);
+    return 0;
+}
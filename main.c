@@ -1,711 +1,9362 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <regex.h>
+#include <sched.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+extern char **environ;
+
 //0 = false, 1 = true
 // Used to check for foreground only mode via cntrl-z
 int foregroundOnlymode = 0;
 
-void handle__SIGTSTP(int signo)
-/* SIGSTSP Signal Handler
-*  Handles the foreground only mode requirement
-*  Toggles Global Variable foregroundOnlymode
-*/
-{
-    if(foregroundOnlymode == 0)
-    {
-        foregroundOnlymode = 1;
-        char *message = "\nEntering foreground-only mode (& is now ignored)\n: ";
-        write(STDOUT_FILENO, message, 53);
-    }else
-    {
-        foregroundOnlymode = 0;
-        char *message = "\nExiting foreground-only mode\n: ";
-        write(STDOUT_FILENO, message, 33);
-    }
-}
+// Shell pid as text for $$ expansion, set once at startup
+char pidString[24];
+size_t pidLength = 0;
+
+// Prompts and per line flushing, false when running a script or non-tty
+bool interactive = true;
 
-struct process
+// Set when stdin is a terminal we prompt on, lines then come from editLine
+bool lineEditing = false;
+
+struct eventSource
 /**************************************************************************
 *   Description -
-*       DLL Node used to store a process PID
-*       Used to kill zombie processes
+*       Descriptor watched by the event loop. runEvents() calls ready()
+*       with the epoll events whenever fd needs attention. Sources are 
+*       owned by their users, the loop only keeps pointers to them.
 *   -----------------------------------------------------------------------
-*    int pid                - Stores the process pid
-*    struct process *next   - Node Next Process
-*    struct process *prev   - Node Previous Process
+*    int fd                 - Watched descriptor, -1 when not in use
+*    void (*ready)()        - Called with the source and its epoll events
+*    void *data             - The handler's own state
 *
 ***************************************************************************/
 {
-    int pid;
-    struct process *next;
-    struct process *prev;
+    int fd;
+    void (*ready)(struct eventSource *source, uint32_t events);
+    void *data;
 };
 
-struct command
-/**************************************************************************
+// The shell's single epoll instance. SIGCHLD, SIGINT and SIGTSTP stay
+// blocked for the life of the shell and are read from signalSource
+int eventFD = -1;
+sigset_t shellSignals;
+
+// Set when SIGCHLD has been read, lets the main loop skip wait4() otherwise
+bool childExited = false;
+
+// SIGTSTPs not acted on yet. They toggle foreground-only mode at the
+// prompt, or once the foreground command has finished (reportStops)
+int stopsPending = 0;
+
+// Server mode (--serve): SIGINT and SIGTERM stop the server once the line
+// running has finished
+bool serving = false;
+bool stopServing = false;
+
+bool watchEvents(struct eventSource *source, uint32_t events)
+/***************************************************************************
 *   Description -
-*       User inputted command used to store information to be assessed in 
-*       program
-*       
-*       command [arg1 arg2 ...] [< input_file] [> output_file] [&]
+*       Adds a source to the event loop
 *
 *   -----------------------------------------------------------------------
-*       char *commandType       - command
-*       char *arguements[512]   - [arg1 arg2 ...]
-*       char *inputFile         - [< input_file]
-*       char *outputFile        - [> output_file]
-*       bool backGround         - [&]
+*   Param - 
+*       struct eventSource *source  - Source with fd and ready set
+*       uint32_t events             - EPOLLIN, EPOLLOUT, ...
 *
-***************************************************************************/
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false if epoll refused the fd
+****************************************************************************/
 {
-    char *commandType;
-    char *arguements[512];
-    char *inputFile;
-    char *outputFile;
-    bool backGround;
-};
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = source;
+    return epoll_ctl(eventFD, EPOLL_CTL_ADD, source->fd, &event) == 0;
+}
+
+void unwatchEvents(struct eventSource *source)
+/***************************************************************************
+*   Description -
+*       Removes a source from the event loop, the fd stays open
+****************************************************************************/
+{
+    epoll_ctl(eventFD, EPOLL_CTL_DEL, source->fd, NULL);
+}
 
-char *dollaDollaParse(char *string)
+bool startTimer(struct eventSource *timer, double seconds)
 /***************************************************************************
 *   Description -
-*       Takes a buffer and converts all '$$' into process pid
+*       Arms a one shot timer. The timerfd is created and watched the 
+*       first time, later calls only re-arm it. ready() must read the 
+*       8 byte expiry count or it fires again.
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       char *string            - String pointer [buffer] 
+*       struct eventSource *timer   - Timer, fd -1 before the first call
+*       double seconds              - Delay from now
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*      char *string             - Converted string
+*      bool                         - false if no timer could be made
 ****************************************************************************/
-{   
-    // Atoi conversion to get string length
-    int pid = getpid();
-    int count = 0;
-    do {
-        pid /=10;
-        ++count;
-    } while (pid != 0);
-
-    // Initialize and set pidString to current pid
-    char pidString[count+1];           
-    sprintf(pidString, "%d", getpid());
-
-    // Counts number of $$ expansions required to set return string length
-    int countDol = 0;
-    for(int x = 0; x < strlen(string); x++)
+{
+    if(timer->fd == -1)
     {
-        if(string[x] == '$' && string[x+1] == '$')
+        timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if(timer->fd == -1)
         {
-            countDol ++;
+            return false;
+        }
+        if(watchEvents(timer, EPOLLIN) == false)
+        {
+            close(timer->fd);
+            timer->fd = -1;
+            return false;
         }
     }
-
-    // No conversion required
-    if (countDol == 0)
+    struct itimerspec when = {{0, 0}, {0, 0}};
+    when.it_value.tv_sec = (time_t)seconds;
+    when.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+    // A zero it_value disarms, the shortest delay is 1ns
+    if(when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0)
     {
-        return string;
+        when.it_value.tv_nsec = 1;
     }
+    return timerfd_settime(timer->fd, 0, &when, NULL) == 0;
+}
 
-    // Initalize and set newString 
-    int length = (countDol * (strlen(pidString))) + strlen(string);
-    char newString[length];
-    newString[length] = '\0';
-    int stringPointer = 0;
-    int newStringPointer = 0;
-
-    // Iterate across string and copy all values over to newString
-    // Exapnds all $$ to pid number
-    while (newStringPointer != length)
+void stopTimer(struct eventSource *timer)
+/***************************************************************************
+*   Description -
+*       Disarms a timer and closes its timerfd
+****************************************************************************/
+{
+    if(timer->fd != -1)
     {
-        if(string[stringPointer] == '$' && string[stringPointer+1] == '$')
-        {
-            for(int x = 0; x < strlen(pidString); x++)
-            {
-                newString[newStringPointer] = pidString[x];
-                newStringPointer ++;
-            }
-            stringPointer ++;
-            stringPointer ++;
-        }
-        else
-        {
-            newString[newStringPointer] = string[stringPointer];
-            newStringPointer ++;
-            stringPointer ++;
-        }
+        unwatchEvents(timer);
+        close(timer->fd);
+        timer->fd = -1;
     }
-
-    // Transfer back to string to return to buffer 
-    strcpy(string, newString);
-    return string;
-    
 }
 
-struct command *parseBuffer(char *buffer)
+void readSignals(struct eventSource *source, uint32_t events)
 /***************************************************************************
 *   Description -
-*       Parses a user command and creates a command structre based off 
-*       of user inputs 
+*       Drains the signalfd. SIGCHLD flags the reaper, SIGTSTP is counted
+*       for reportStops() and SIGINT is dropped: it only concerns the
+*       foreground command, which gets it from the terminal directly.
+*       A server stops on SIGINT or SIGTERM instead.
+*       The signalfd is non-blocking so this also polls between lines.
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       char *buffer            - Pointer to 'buffer' in main() function
+*       struct eventSource *source  - signalSource
+*       uint32_t events             - Unused
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*      command structre         - currCommand
+*      None
 ****************************************************************************/
 {
-    //If buffer is blank
-    if (strlen(buffer) == 0)
-    {
-        struct command *currCommand = malloc(sizeof(struct command));
-        currCommand->commandType = calloc(5 + 1, sizeof(char));
-        strcpy(currCommand->commandType, "Blank");
-        return currCommand;
-    }
-
-    // Token intialization -> Used to break apart the user command
-    struct command *currCommand = malloc(sizeof(struct command));
-    char *saveptr;
-    char *token = strtok_r(buffer, " ", &saveptr);
-
-    // If buffer is blank or a comment
-    if (token == NULL || token[0] == '#' || token[0] == '\0')
-    {
-        struct command *currCommand = malloc(sizeof(struct command));
-        currCommand->commandType = calloc(5 + 1, sizeof(char));
-        strcpy(currCommand->commandType, "Blank");
-        return currCommand;
-    }
-
-    // Set commandType to first token (always exist, will always be a command)
-    currCommand->commandType = calloc(strlen(token) + 1, sizeof(char));
-    strcpy(currCommand->commandType, token);
-
-    // Initialize loop set up 
-    bool bArguements = true;    //Arguments set to true meaning we will look for these first
-    bool inputFile = false;     // Input and output files set to false, will turn true if > or < is parsed
-    bool outputFile = false;
-    int i = 0;                  // Used for arguement count
-
-    // Parse rest of the command until our saveptr is empty or null
-    while((int)strlen(saveptr) != 0)
+    struct signalfd_siginfo info[16];
+    ssize_t count;
+    while((count = read(source->fd, info, sizeof(info))) > 0)
     {
-        // set token to equal next word in command
-        char *token = strtok_r(NULL, " ", &saveptr);
-        // Break -> Avoid Segmentation Fault
-        if(token == NULL)
-        {
-            break;
-        }
-        // Switch 'flags' to change next token assessment (such that we place input in Input and output to Output)
-        if(strcmp(token, ">") == 0 || strcmp(token,"<") == 0 || (strcmp(token,"&") == 0 && (int)strlen(saveptr) == 0))
+        for(size_t x = 0; x < count / sizeof(info[0]); x++)
         {
-            if(strcmp(token, "<") == 0)
+            if(info[x].ssi_signo == SIGCHLD)
             {
-                inputFile = true;
-                bArguements = false;
-                continue;
+                childExited = true;
             }
-            else if(strcmp(token, ">") == 0)
+            else if(info[x].ssi_signo == SIGTSTP)
             {
-                outputFile = true;
-                bArguements = false;
-                continue;
+                stopsPending ++;
             }
-            else
+            else if(serving == true)
             {
-                // In the case that & is not last, we will not toggle background process
-                currCommand->backGround = true;
-                break;
+                stopServing = true;
             }
         }
+    }
+}
 
-        // Argument assessment
-        if(inputFile == false && outputFile == false && bArguements == true && i < 512)
-        {
-            currCommand->arguements[i] = calloc(strlen(token)+1, sizeof(char));
-            currCommand->arguements[i] = token;
-            i ++;                                                                             
-        }
+struct eventSource signalSource = {-1, readSignals, NULL};
 
-        else if(inputFile == true)
+bool reportStops(void)
+/***************************************************************************
+*   Description -
+*       Acts on pending SIGTSTPs: each one toggles foregroundOnlymode and
+*       says so. Called at the prompt and between commands, never while
+*       a foreground command runs, so the message follows its output.
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - true if a message was printed
+****************************************************************************/
+{
+    if(stopsPending == 0)
+    {
+        return false;
+    }
+    for(; stopsPending > 0; stopsPending --)
+    {
+        if(foregroundOnlymode == 0)
         {
-            currCommand->inputFile = calloc(strlen(token) + 1, sizeof(char));   
-            strcpy(currCommand->inputFile, token);
-            inputFile = false;
-        }
-
-        else if(outputFile == true)
+            foregroundOnlymode = 1;
+            printf("\nEntering foreground-only mode (& is now ignored)\n");
+        }else
         {
-            currCommand->outputFile = calloc(strlen(token) + 1, sizeof(char));
-            strcpy(currCommand->outputFile, token);
-            outputFile = false;
+            foregroundOnlymode = 0;
+            printf("\nExiting foreground-only mode\n");
         }
     }
-    return currCommand;
+    fflush(stdout);
+    return true;
 }
 
-void exitProcess(struct process *pointer)
+void runEvents(int timeout)
 /***************************************************************************
 *   Description -
-*       Exits our shell. It takes no arguments. When this command is run, 
-*       our shell will kill any other processes or jobs that our shell has 
-*       started before it terminates itself.
+*       One turn of the event loop: waits for any watched source, up to
+*       timeout milliseconds (-1 forever), and calls the ready handlers
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       struct process *pointer - MainProcess and linked list of processes
+*       int timeout                 - epoll_wait() timeout
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*      Breaks from loop to free() structures and EXITS program
+*      None
 ****************************************************************************/
+{
+    struct epoll_event events[16];
+    int count = epoll_wait(eventFD, events, 16, timeout);
+    for(int x = 0; x < count; x++)
     {
-        // Point to process after main
-        pointer = pointer->next;
-        // Iterates across processes and kills them
-        while(pointer != NULL)
-        {
-            int pid = pointer->pid;
-            int count = 0;
-            do {
-                pid /=10;
-                ++count;
-            } while (pid != 0);
-            char pidString[count];
-            sprintf(pidString, "%d", pointer->pid);
-            kill(pointer->pid, SIGUSR1);
-            pointer->prev->next = pointer->next;
-            if(pointer->next != NULL)
-            {
-                pointer->next->prev = pointer->prev;    
-            }
-            pointer = pointer->next;
-        }
+        struct eventSource *source = events[x].data.ptr;
+        source->ready(source, events[x].events);
     }
+}
 
-void cdProcess(struct command *ourCommand)
+pid_t waitEvent(pid_t pid, int *childStatus, int options, struct rusage *childUsage)
 /***************************************************************************
 *   Description -
-*       The cd command changes the working directory of smallsh.
-*
-*       By itself - with no arguments - it changes to the directory specified 
-*       in the HOME environment variable
-*       This command can also take one argument: the path of a directory to 
-*       change to. Your cd command should support both absolute and relative 
-*       paths.
+*       wait4() for foreground waits, driven by the event loop instead of
+*       blocking in the kernel. Signals and timers are handled while the
+*       child runs, other children that exit meanwhile are left for
+*       reapProcesses().
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       struct command *ourCommand      - Carries our arguements
+*       As wait4(), WNOHANG is added to options
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*      None
+*      pid_t                        - As wait4(), never 0
 ****************************************************************************/
 {
-    // No arguments == go home
-    if(ourCommand->arguements[0] == NULL)
-    {   
-        chdir(getenv("HOME"));
-        return;
-    }
-
-    // Initilize path
-    char *buffer[2048];
-    *buffer = getcwd(*buffer, sizeof(buffer));
-    strcat(*buffer, "/");
-    strcat(*buffer, ourCommand->arguements[0]);
-    //Relative
-    if (chdir(*buffer) == 0)
-    {}
-    //Absolute
-    else if (chdir(ourCommand->arguements[0]) ==0 )
-    {}
-    else
+    pid_t result;
+    while((result = wait4(pid, childStatus, options | WNOHANG, childUsage)) == 0)
     {
-        printf("Attempt %s  or  %s\n", ourCommand->arguements[0], *buffer);
-        printf("No such file or directory\n");
-        fflush(stdout);
+        runEvents(-1);
     }
+    return result;
 }
 
-void statusProcess(int* FGS)
+struct usage
+/**************************************************************************
+*   Description -
+*       Resources a command used, collected from wait4() as its processes
+*       are reaped. CPU times, faults and context switches are summed over
+*       the processes, max RSS is the largest single process.
+*   -----------------------------------------------------------------------
+*    struct timespec started - When the command was launched
+*    double wall            - Seconds from launch until the last exit
+*    struct rusage rusage   - Totals of every reaped process
+*    char *text             - Command line of a finished job, else NULL
+*
+***************************************************************************/
+{
+    struct timespec started;
+    double wall;
+    struct rusage rusage;
+    char *text;
+};
+
+// Last foreground command and last finished background job, for status -v
+struct usage foregroundUsage;
+struct usage jobUsage;
+int foregroundRuns = 0;     // Bumped whenever foregroundUsage is replaced
+
+// Exit status of a foreground command that ran out of time (see timeout),
+// the same as timeout(1)
+#define TIMEOUT_STATUS 124
+bool foregroundTimedOut = false;
+
+// Shell wide limit and grace period before SIGKILL (timeout -d), and the
+// ones of this line (timeout prefix), in seconds. 0 means no limit
+double defaultTimeout = 0;
+double defaultGrace = 5;
+double lineTimeout = 0;
+double lineGrace = 5;
+
+struct job
+/**************************************************************************
+*   Description -
+*       Job table record for one background command line (every stage of
+*       a pipeline). Records live in a slab indexed by job id - 1 so a job
+*       keeps its id for its whole life. Free records are chained through 
+*       nextFree and reused before the slab grows.
+*   -----------------------------------------------------------------------
+*    bool used              - Record holds a live job
+*    pid_t *pids            - Every process of the job, last stage last.
+*                             pids[0] leads the job's process group
+*    int count              - Number of processes in pids
+*    int running            - Processes not reaped yet
+*    int lastStatus         - Wait status of the last stage once reaped
+*    bool stopped           - Job was stopped by a signal
+*    char *text             - Command line shown by jobs
+*    struct usage usage     - Resources of the processes reaped so far
+*    char **audit           - Audit record heads by pid, NULL when off
+*    int nextFree           - Next free record index, -1 ends the list
+*
+***************************************************************************/
+{
+    bool used;
+    pid_t *pids;
+    int count;
+    int running;
+    int lastStatus;
+    bool stopped;
+    char *text;
+    struct usage usage;
+    char **audit;
+    int nextFree;
+};
+
+struct jobPid
+/**************************************************************************
+*   Description -
+*       Slot of the pid index, an open addressing hash from a process pid
+*       to the slab index of its job
+*   -----------------------------------------------------------------------
+*    pid_t pid              - Process pid, 0 marks an empty slot
+*    int job                - Slab index of the owning job
+*
+***************************************************************************/
+{
+    pid_t pid;
+    int job;
+};
+
+// Job slab with its free list and the pid index into it
+struct job *jobSlab = NULL;
+int jobCapacity = 0;
+int jobFree = -1;
+int jobsRunning = 0;    // Jobs not stopped, so wait knows when to return
+int lastJob = 0;        // Id of the most recently started job
+struct jobPid *pidTable = NULL;
+int pidCapacity = 0;
+int pidCount = 0;
+
+struct command
+/**************************************************************************
+*   Description -
+*       User inputted command used to store information to be assessed in 
+*       program
+*       
+*       command [arg1 arg2 ...] [< input_file] [> output_file] 
+*           [| command ...] [&]
+*
+*       Each '|' separated stage of a pipeline is its own command, linked
+*       through next. backGround, substitute and glob are only set on the
+*       first stage.
+*       argv is sized to the number of words on the line and is handed to
+*       exec as is, arguements points just past the command inside it.
+*
+*   -----------------------------------------------------------------------
+*       char *commandType       - command
+*       char **argv             - command arg1 arg2 ... NULL
+*       char **arguements       - [arg1 arg2 ...] NULL
+*       char *inputFile         - [< input_file]
+*       char *outputFile        - [> output_file]
+*       bool backGround         - [&]
+*       bool substitute         - A word holds $(command), still unexpanded
+*       bool glob               - The line has *, ? or [, see globCommand()
+*       struct command *next    - [| command ...]
+*
+***************************************************************************/
+{
+    char *commandType;
+    char **argv;
+    char **arguements;
+    char *inputFile;
+    char *outputFile;
+    bool backGround;
+    bool substitute;
+    bool glob;
+    struct command *next;
+};
+
+struct lineReader
+/**************************************************************************
+*   Description -
+*       Input of the shell, handed out one line at a time with no length
+*       limit. Regular files (scripts) are mapped whole and lines point
+*       straight into the mapping. Terminals and pipes are read with
+*       large read() calls into a buffer that grows for long lines.
+*   -----------------------------------------------------------------------
+*    int fd                 - Input descriptor
+*    char *data             - Mapped file or read buffer
+*    size_t start           - First byte not handed out yet
+*    size_t filled          - Valid bytes in data
+*    size_t capacity        - Size of the read buffer, 0 when mapped
+*    bool eof               - No more data will arrive
+*
+***************************************************************************/
+{
+    int fd;
+    char *data;
+    size_t start;
+    size_t filled;
+    size_t capacity;
+    bool eof;
+};
+
+// Where command lines come from
+struct lineReader inputReader;
+
+struct arena
+/**************************************************************************
+*   Description -
+*       Bump allocator holding everything built for one command line. 
+*       Reset after every line, which releases it all at once. Requests
+*       that do not fit go to overflow chunks, and the next reset grows 
+*       the main block so a steady workload uses a single block.
+*   -----------------------------------------------------------------------
+*    char *block            - Main block
+*    size_t size            - Size of the main block
+*    size_t used            - Bytes handed out from the main block
+*    size_t overflowSize    - Bytes handed out from overflow chunks
+*    void *overflow         - Overflow chunks, each starts with the 
+*                             pointer to the next
+*
+***************************************************************************/
+{
+    char *block;
+    size_t size;
+    size_t used;
+    size_t overflowSize;
+    void *overflow;
+};
+
+void *arenaAlloc(struct arena *lineArena, size_t size)
 /***************************************************************************
 *   Description -
-*   The status command prints out either the exit status or the terminating 
-*   signal of the last foreground process ran by your shell.
-*   
-*    If this command is run before any foreground command is run, it'll 
-*    return the exit status 0.
-*    The three built-in shell commands do not count as foreground processes 
+*       Hands out size bytes (16 byte aligned) that live until the next
+*       arenaReset()
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       int* FGS        - Last exit status of a foreground process
+*       struct arena *lineArena - Arena to allocate from
+*       size_t size             - Bytes needed
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*       None
+*      void *                   - Uninitialized memory
 ****************************************************************************/
+{
+    size = (size + 15) & ~(size_t)15;
+    if(lineArena->size - lineArena->used >= size)
     {
-        printf("exit value %d\n", *FGS);
-        fflush(stdout);
+        void *memory = lineArena->block + lineArena->used;
+        lineArena->used += size;
+        return memory;
     }
 
-void otherProcess(struct command *ourCommand, struct process *process, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+    // Does not fit, chain an overflow chunk
+    void **chunk = malloc(16 + size);
+    *chunk = lineArena->overflow;
+    lineArena->overflow = chunk;
+    lineArena->overflowSize += size;
+    return (char *)chunk + 16;
+}
+
+void *arenaZero(struct arena *lineArena, size_t size)
 /***************************************************************************
 *   Description -
-*   Whenever a non-built in command is received, the parent (i.e., smallsh) 
-*   will fork off a child.
-*   
-*   The child will use a function from the exec() family of functions to 
-*   run the command.
-*   
-*   Your shell should use the PATH variable to look for non-built in commands, 
-*   and it should allow shell scripts to be executed
-*   
-*   If a command fails because the shell could not find the command to run, 
-*   then the shell will print an error message and set the exit status to 1
-*   
-*   A child process must terminate after running a command 
-*   (whether the command is successful or it fails). 
+*       arenaAlloc() for memory that must start out zeroed
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       struct command *ourCommand      - Command structre
-*       struct process *process         - Process LL
-*       int* FGS                        - Foreground exit status
-*       struct sigaction SIGINT_action  - SIGINT handler
-*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*       struct arena *lineArena - Arena to allocate from
+*       size_t size             - Bytes needed
 *
 *   -----------------------------------------------------------------------
 *   Returns
-*       None
+*      void *                   - Zeroed memory
 ****************************************************************************/
 {
-    // Initialize arguements
-    char *amper = "&";
-    int size = 0;
-    // Count arguements to set **arguement array size
-    for(int x = 0; x < sizeof(ourCommand->arguements)/sizeof(ourCommand->arguements[0]); x++)
-    {                                                      
-        if(ourCommand->arguements[x] == NULL)
-        {
-            break;
-        }
-        size ++;
-    }
-    size = size + 2;
-    char **arguement[size];
-
-    // set our first arguement to the command
-    arguement[0] = &ourCommand->commandType;
-
-    // Iterate across our arguements in ourCommand and add to arguement
-    for(int x = 1; x < size-1; x ++)
-    {
-        arguement[x] = &ourCommand->arguements[x-1];
-    }
+    return memset(arenaAlloc(lineArena, size), 0, size);
+}
 
-    // Include amper for background commands
-    if(ourCommand->backGround == true && foregroundOnlymode == 0)
-    {
-        arguement[size-1] = &amper;
-    }
-    else
-    {
-    arguement[size-1] = NULL;
+void arenaTrim(struct arena *lineArena, void *memory, size_t allocated, size_t size)
+/***************************************************************************
+*   Description -
+*       Shrinks an allocation to size bytes, handing the rest back. Only
+*       the most recent allocation can shrink, others are left as they 
+*       are.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct arena *lineArena - Arena the memory came from
+*       void *memory            - Allocation to shrink
+*       size_t allocated        - Size it was allocated with
+*       size_t size             - Bytes actually used
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char *start = memory;
+    if(start >= lineArena->block && start + ((allocated + 15) & ~(size_t)15) == lineArena->block + lineArena->used)
+    {
+        lineArena->used = (start - lineArena->block) + ((size + 15) & ~(size_t)15);
+    }
+}
+
+void arenaReset(struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Releases everything allocated from the arena. Only frees memory if
+*       the last line overflowed, in which case the main block is regrown
+*       to fit such a line next time.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct arena *lineArena - Arena to reset
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(lineArena->overflow != NULL)
+    {
+        while(lineArena->overflow != NULL)
+        {
+            void *next = *(void **)lineArena->overflow;
+            free(lineArena->overflow);
+            lineArena->overflow = next;
+        }
+        size_t needed = lineArena->used + lineArena->overflowSize;
+        while(lineArena->size < needed)
+        {
+            lineArena->size = lineArena->size == 0 ? 4096 : lineArena->size * 2;
+        }
+        free(lineArena->block);
+        lineArena->block = malloc(lineArena->size);
+        lineArena->overflowSize = 0;
+    }
+    lineArena->used = 0;
+}
+
+struct command *parseBuffer(const char *buffer, size_t length, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Parses a user command and creates a command structre based off 
+*       of user inputs, in a single pass over the buffer. Each word is 
+*       found with memchr(), copied into lineArena with every '$$' 
+*       expanded to the shell pid, and classified (<, >, |, trailing &) 
+*       as soon as the next word is known. buffer is never written to.
+*       A $(command) is kept as it is, spaces included, up to its 
+*       matching ')' and flags the line for substituteCommand(). A line
+*       that may hold patterns is flagged for globCommand().
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *buffer      - User command, no newline
+*       size_t length           - Length of buffer
+*       struct arena *lineArena - Per line arena
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      command structre         - currCommand
+****************************************************************************/
+{
+    struct command *currCommand = arenaZero(lineArena, sizeof(struct command));
+    const char *end = buffer + length;
+    const char *scan = buffer;
+    while(scan < end && *scan == ' ')
+    {
+        scan ++;
+    }
+
+    // If buffer is blank or a comment
+    if (scan == end || *scan == '#')
+    {
+        currCommand->commandType = "Blank";
+        return currCommand;
+    }
+
+    currCommand->glob = memchr(scan, '*', end - scan) != NULL || memchr(scan, '?', end - scan) != NULL ||
+                        memchr(scan, '[', end - scan) != NULL;
+
+    // Worst case sizes: one letter words, and every '$$' grows to the pid
+    size_t maxWords = (length + 1) / 2 + 1;
+    char *text = arenaAlloc(lineArena, length + (length / 2) * pidLength + maxWords + 1);
+    char **slots = arenaAlloc(lineArena, (maxWords + 1) * sizeof(char *));
+    int slot = 0;
+
+    // Locals, so stores into text can't force reloads of the globals
+    const char *pidText = pidString;
+    size_t pidSize = pidLength;
+
+    // Initialize loop set up 
+    bool newStage = true;       // Next word is the command of a stage
+    bool bArguements = true;    //Arguments set to true meaning we will look for these first
+    bool inputFile = false;     // Input and output files set to false, will turn true if > or < is parsed
+    bool outputFile = false;
+    struct command *currStage = currCommand;    // Pipeline stage being filled
+    char *token = NULL;         // Word waiting to be classified
+
+    while(true)
+    {
+        // Lex the next word, if any
+        while(scan < end && *scan == ' ')
+        {
+            scan ++;
+        }
+        char *next = NULL;
+        if(scan < end)
+        {
+            // memchr() finds the end of the word, then one copy loop 
+            // expands $$ on the way
+            const char *wordEnd = memchr(scan, ' ', end - scan);
+            if(wordEnd == NULL)
+            {
+                wordEnd = end;
+            }
+            next = text;
+            while(scan < wordEnd)
+            {
+                if(scan[0] == '$' && scan + 1 < wordEnd && scan[1] == '$')
+                {
+                    memcpy(text, pidText, pidSize);
+                    text += pidSize;
+                    scan += 2;
+                }
+                else if(scan[0] == '$' && scan + 1 < wordEnd && scan[1] == '(')
+                {
+                    // Copy through the matching ')', which may be words away
+                    const char *close = scan + 2;
+                    for(int depth = 1; close < end; close++)
+                    {
+                        depth += (*close == '(') - (*close == ')');
+                        if(depth == 0)
+                        {
+                            break;
+                        }
+                    }
+                    if(close == end)
+                    {
+                        *text++ = *scan++;
+                        continue;
+                    }
+                    memcpy(text, scan, close + 1 - scan);
+                    text += close + 1 - scan;
+                    scan = close + 1;
+                    if(scan > wordEnd)
+                    {
+                        wordEnd = memchr(scan, ' ', end - scan);
+                        wordEnd = wordEnd != NULL ? wordEnd : end;
+                    }
+                    currCommand->substitute = true;
+                }
+                else
+                {
+                    *text++ = *scan++;
+                }
+            }
+            *text++ = '\0';
+            scan = wordEnd;
+        }
+
+        // Classify the previous word now that we know if it was the last
+        if(token != NULL)
+        {
+            bool special = token[0] != '\0' && token[1] == '\0';
+            if(newStage == true)
+            {
+                // Set commandType (always exist, will always be a command)
+                if(currStage->argv != NULL)
+                {
+                    // Close the previous stage's argv, its '|' word left a spare slot
+                    slots[slot++] = NULL;
+                    currStage->next = arenaZero(lineArena, sizeof(struct command));
+                    currStage = currStage->next;
+                }
+                currStage->commandType = token;
+                currStage->argv = &slots[slot];
+                slots[slot++] = token;
+                currStage->arguements = &slots[slot];
+                newStage = false;
+                bArguements = true;
+                inputFile = false;
+                outputFile = false;
+            }
+            // Pipe -> next word is the command of a new pipeline stage
+            else if(special == true && token[0] == '|')
+            {
+                newStage = true;
+            }
+            else if(special == true && token[0] == '<')
+            {
+                inputFile = true;
+                bArguements = false;
+            }
+            else if(special == true && token[0] == '>')
+            {
+                outputFile = true;
+                bArguements = false;
+            }
+            // In the case that & is not last, we will not toggle background process
+            // & always applies to the whole pipeline (first stage)
+            else if(special == true && token[0] == '&' && next == NULL)
+            {
+                currCommand->backGround = true;
+            }
+            // Argument assessment
+            else if(inputFile == true)
+            {
+                currStage->inputFile = token;
+                inputFile = false;
+            }
+            else if(outputFile == true)
+            {
+                currStage->outputFile = token;
+                outputFile = false;
+            }
+            else if(bArguements == true)
+            {
+                slots[slot++] = token;
+            }
+        }
+
+        if(next == NULL)
+        {
+            break;
+        }
+        token = next;
+    }
+    slots[slot++] = NULL;
+
+    // Hand back the unused argv slots
+    arenaTrim(lineArena, slots, (maxWords + 1) * sizeof(char *), slot * sizeof(char *));
+    return currCommand;
+}
+
+// Parsed line cache, see cachedParse()
+#define LINE_CACHE_DEFAULT 256      // Lines kept by default (cache -s N)
+#define LINE_CACHE_LONGEST 4096     // Longer lines are never cached
+#define LINE_SEEN_SLOTS 1024        // Admission filter size, a power of 2
+
+struct cachedLine
+/**************************************************************************
+*   Description -
+*       Entry of the parsed line cache: a line and an immutable deep copy 
+*       of the command parsed from it, both in one malloc'd block. Entries 
+*       sit in a fixed array, chained into hash buckets and into a least 
+*       recently used list by index.
+*   -----------------------------------------------------------------------
+*    unsigned long hash     - hashBytes() of the line
+*    size_t length          - Length of the line
+*    const char *line       - The line, inside block
+*    struct command *command - Parsed command, inside block
+*    void *block            - Owns everything above, NULL if unused
+*    int newer              - More recently used entry, -1 at the front
+*    int older              - Less recently used entry, -1 at the back
+*    int chain              - Next entry in the same bucket, -1 ends it
+*
+***************************************************************************/
+{
+    unsigned long hash;
+    size_t length;
+    const char *line;
+    struct command *command;
+    void *block;
+    int newer;
+    int older;
+    int chain;
+};
+
+struct cachedLine *lineCache = NULL;
+int lineCacheCapacity = LINE_CACHE_DEFAULT;
+int lineCacheCount = 0;
+int *lineBuckets = NULL;
+int lineBucketMask = 0;
+int newestLine = -1;
+int oldestLine = -1;
+// Hashes of recently missed lines, a line is cached on its second miss
+unsigned long lineSeen[LINE_SEEN_SLOTS];
+// Counters shown by the cache built in
+unsigned long lineHits = 0;
+unsigned long lineMisses = 0;
+unsigned long lineEvictions = 0;
+
+unsigned long hashBytes(const char *data, size_t length)
+/***************************************************************************
+*   Description -
+*       Hash of a byte range, eight bytes per step
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *data        - Bytes to hash
+*       size_t length           - Number of bytes
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      unsigned long            - Hash value, never 0
+****************************************************************************/
+{
+    unsigned long hash = length * 0x9E3779B97F4A7C15UL;
+    unsigned long word;
+    while(length >= 8)
+    {
+        memcpy(&word, data, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDUL;
+        hash ^= hash >> 32;
+        data += 8;
+        length -= 8;
+    }
+    word = 0;
+    memcpy(&word, data, length);
+    hash = (hash ^ word) * 0xC4CEB9FE1A85EC53UL;
+    hash ^= hash >> 29;
+    return hash != 0 ? hash : 1;
+}
+
+void *copyCommand(const char *line, size_t length, struct command *source, struct command **copy, const char **lineCopy)
+/***************************************************************************
+*   Description -
+*       Deep copies a line and the command parsed from it (every pipeline
+*       stage, argv and file name) into a single exact sized block
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *line        - The line
+*       size_t length           - Length of the line
+*       struct command *source  - Command parsed from it
+*       struct command **copy   - Set to the copied command
+*       const char **lineCopy   - Set to the copied line
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      void *                   - The block, free() releases everything
+****************************************************************************/
+{
+    // Commands, then argv slots, then characters so pointers stay aligned
+    size_t commands = 0;
+    size_t slots = 0;
+    size_t characters = length;
+    for(struct command *stage = source; stage != NULL; stage = stage->next)
+    {
+        commands ++;
+        if(stage->argv == NULL)
+        {
+            characters += strlen(stage->commandType) + 1;
+            continue;
+        }
+        for(char **word = stage->argv; *word != NULL; word++)
+        {
+            slots ++;
+            characters += strlen(*word) + 1;
+        }
+        slots ++;
+        characters += stage->inputFile != NULL ? strlen(stage->inputFile) + 1 : 0;
+        characters += stage->outputFile != NULL ? strlen(stage->outputFile) + 1 : 0;
+    }
+    char *block = malloc(commands * sizeof(struct command) + slots * sizeof(char *) + characters);
+    struct command *command = (struct command *)block;
+    char **slot = (char **)(command + commands);
+    char *text = (char *)(slot + slots);
+    memcpy(text, line, length);
+    *lineCopy = text;
+    text += length;
+
+    for(struct command *stage = source; stage != NULL; stage = stage->next, command++)
+    {
+        *command = *stage;
+        command->next = stage->next != NULL ? command + 1 : NULL;
+        if(stage->argv == NULL)
+        {
+            command->commandType = strcpy(text, stage->commandType);
+            text += strlen(text) + 1;
+            continue;
+        }
+        command->argv = slot;
+        for(char **word = stage->argv; *word != NULL; word++)
+        {
+            *slot++ = strcpy(text, *word);
+            text += strlen(text) + 1;
+        }
+        *slot++ = NULL;
+        command->commandType = command->argv[0];
+        command->arguements = command->argv + 1;
+        if(stage->inputFile != NULL)
+        {
+            command->inputFile = strcpy(text, stage->inputFile);
+            text += strlen(text) + 1;
+        }
+        if(stage->outputFile != NULL)
+        {
+            command->outputFile = strcpy(text, stage->outputFile);
+            text += strlen(text) + 1;
+        }
+    }
+    *copy = (struct command *)block;
+    return block;
+}
+
+void unlinkLine(int index)
+/***************************************************************************
+*   Description -
+*       Takes a cache entry out of the least recently used list
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int index               - Entry to unlink
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct cachedLine *entry = &lineCache[index];
+    if(entry->newer != -1)
+    {
+        lineCache[entry->newer].older = entry->older;
+    }
+    else
+    {
+        newestLine = entry->older;
+    }
+    if(entry->older != -1)
+    {
+        lineCache[entry->older].newer = entry->newer;
+    }
+    else
+    {
+        oldestLine = entry->newer;
+    }
+}
+
+void pushLine(int index)
+/***************************************************************************
+*   Description -
+*       Puts a cache entry at the most recently used end of the list
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int index               - Entry to push
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    lineCache[index].newer = -1;
+    lineCache[index].older = newestLine;
+    if(newestLine != -1)
+    {
+        lineCache[newestLine].newer = index;
+    }
+    newestLine = index;
+    if(oldestLine == -1)
+    {
+        oldestLine = index;
+    }
+}
+
+void clearLineCache(void)
+/***************************************************************************
+*   Description -
+*       Frees every cached line and the cache tables. The next 
+*       cachedParse() builds them again at lineCacheCapacity.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    for(int x = 0; lineCache != NULL && x < lineCacheCount; x++)
+    {
+        free(lineCache[x].block);
+    }
+    free(lineCache);
+    free(lineBuckets);
+    lineCache = NULL;
+    lineBuckets = NULL;
+    lineCacheCount = 0;
+    newestLine = -1;
+    oldestLine = -1;
+    memset(lineSeen, 0, sizeof(lineSeen));
+}
+
+struct command *cachedParse(const char *buffer, size_t length, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       parseBuffer() with a bounded least recently used cache in front.
+*       A line seen before returns its cached command with no lexing or
+*       allocation. A line is only copied into the cache on its second 
+*       miss, so scripts of one off lines pay just the hash. When full,
+*       the least recently used line is evicted.
+*
+*       The returned command is shared with the cache and must not be 
+*       modified. It stays valid until the next call.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *buffer      - User command, no newline
+*       size_t length           - Length of buffer
+*       struct arena *lineArena - Per line arena, used on a miss
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      command structre         - Parsed command
+****************************************************************************/
+{
+    if(lineCacheCapacity == 0 || length > LINE_CACHE_LONGEST)
+    {
+        return parseBuffer(buffer, length, lineArena);
+    }
+    if(lineCache == NULL)
+    {
+        lineCache = malloc(lineCacheCapacity * sizeof(struct cachedLine));
+        int buckets = 16;
+        while(buckets < lineCacheCapacity * 2)
+        {
+            buckets *= 2;
+        }
+        lineBuckets = malloc(buckets * sizeof(int));
+        memset(lineBuckets, -1, buckets * sizeof(int));
+        lineBucketMask = buckets - 1;
+    }
+
+    unsigned long hash = hashBytes(buffer, length);
+    int *link = &lineBuckets[hash & lineBucketMask];
+    for(int index = *link; index != -1; index = lineCache[index].chain)
+    {
+        struct cachedLine *entry = &lineCache[index];
+        if(entry->hash == hash && entry->length == length && memcmp(entry->line, buffer, length) == 0)
+        {
+            lineHits ++;
+            if(newestLine != index)
+            {
+                unlinkLine(index);
+                pushLine(index);
+            }
+            return entry->command;
+        }
+    }
+
+    lineMisses ++;
+    struct command *parsed = parseBuffer(buffer, length, lineArena);
+    unsigned long *seen = &lineSeen[hash & (LINE_SEEN_SLOTS - 1)];
+    if(*seen != hash)
+    {
+        *seen = hash;
+        return parsed;
+    }
+
+    // Second miss, cache it in a free entry or the least recently used one
+    int index = lineCacheCount;
+    if(lineCacheCount < lineCacheCapacity)
+    {
+        lineCacheCount ++;
+    }
+    else
+    {
+        index = oldestLine;
+        unlinkLine(index);
+        int *old = &lineBuckets[lineCache[index].hash & lineBucketMask];
+        while(*old != index)
+        {
+            old = &lineCache[*old].chain;
+        }
+        *old = lineCache[index].chain;
+        free(lineCache[index].block);
+        lineEvictions ++;
+    }
+    struct cachedLine *entry = &lineCache[index];
+    entry->hash = hash;
+    entry->length = length;
+    entry->block = copyCommand(buffer, length, parsed, &entry->command, &entry->line);
+    entry->chain = *link;
+    *link = index;
+    pushLine(index);
+    return parsed;
+}
+
+char *describeCommand(struct command *ourCommand)
+/***************************************************************************
+*   Description -
+*       Rebuilds the command line of a (pipeline) command for display
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - First stage of the command
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      char *                           - malloc'd command line
+****************************************************************************/
+{
+    char *text = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&text, &length);
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next)
+    {
+        fputs(stage->commandType, stream);
+        for(int x = 0; stage->arguements[x] != NULL; x++)
+        {
+            fprintf(stream, " %s", stage->arguements[x]);
+        }
+        if(stage->inputFile != NULL)
+        {
+            fprintf(stream, " < %s", stage->inputFile);
+        }
+        if(stage->outputFile != NULL)
+        {
+            fprintf(stream, " > %s", stage->outputFile);
+        }
+        if(stage->next != NULL)
+        {
+            fputs(" | ", stream);
+        }
+    }
+    if(ourCommand->backGround == true)
+    {
+        fputs(" &", stream);
+    }
+    fclose(stream);
+    return text;
+}
+
+// Execution audit log, a JSON line per command run (audit built in or
+// SMALLSH_AUDIT). Records wait in a ring and are written in batches
+#define AUDIT_RING_SIZE (256 * 1024)
+#define AUDIT_FLUSH_DELAY 1.0       // Longest a record waits in the ring, s
+
+struct auditLog
+/**************************************************************************
+*   Description -
+*       Audit log state. Records are appended to ring and written with 
+*       one writev() when the shell goes idle (prompt, exit), when the
+*       ring is half full, or AUDIT_FLUSH_DELAY after the first record 
+*       waiting (timer, run by the event loop during foreground waits).
+*       A record that does not fit is dropped and counted.
+*   -----------------------------------------------------------------------
+*    int fd                 - Log file, -1 while auditing is off
+*    char *path             - Its name, for the audit built in
+*    char *ring             - AUDIT_RING_SIZE bytes
+*    size_t start           - Oldest byte not written yet
+*    size_t used            - Bytes waiting
+*    int waiting            - Records waiting
+*    unsigned long records  - Records logged
+*    unsigned long dropped  - Records lost to a full ring or failed write
+*    struct eventSource timer - Flush timer
+*    bool armed             - The timer is running
+*
+***************************************************************************/
+{
+    int fd;
+    char *path;
+    char *ring;
+    size_t start;
+    size_t used;
+    int waiting;
+    unsigned long records;
+    unsigned long dropped;
+    struct eventSource timer;
+    bool armed;
+};
+
+struct auditLog audit = {-1, NULL, NULL, 0, 0, 0, 0, 0, {-1, NULL, NULL}, false};
+
+void auditFlush(void)
+/***************************************************************************
+*   Description -
+*       Writes every waiting record with a single writev(), the ring may
+*       wrap so it is one or two pieces
+****************************************************************************/
+{
+    if(audit.used == 0)
+    {
+        return;
+    }
+    size_t first = AUDIT_RING_SIZE - audit.start;
+    first = first < audit.used ? first : audit.used;
+    struct iovec pieces[2] = {{audit.ring + audit.start, first}, {audit.ring, audit.used - first}};
+    if(writev(audit.fd, pieces, audit.used > first ? 2 : 1) != (ssize_t)audit.used)
+    {
+        audit.dropped += audit.waiting;
+        audit.records -= audit.waiting;
+    }
+    audit.start = (audit.start + audit.used) % AUDIT_RING_SIZE;
+    audit.used = 0;
+    audit.waiting = 0;
+}
+
+void auditTimer(struct eventSource *timer, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Flush timer handler
+****************************************************************************/
+{
+    uint64_t expirations;
+    if(read(timer->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+    {
+        audit.armed = false;
+        auditFlush();
+    }
+}
+
+void auditString(FILE *stream, const char *text)
+/***************************************************************************
+*   Description -
+*       Writes text as a JSON string, null for NULL
+****************************************************************************/
+{
+    if(text == NULL)
+    {
+        fputs("null", stream);
+        return;
+    }
+    fputc('"', stream);
+    for(; *text != '\0'; text++)
+    {
+        unsigned char byte = *text;
+        if(byte == '"' || byte == '\\')
+        {
+            fputc('\\', stream);
+            fputc(byte, stream);
+        }
+        else if(byte < 0x20)
+        {
+            fprintf(stream, "\\u%04x", byte);
+        }
+        else
+        {
+            fputc(byte, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+char *auditHead(struct command *stage, pid_t pid, bool backGround, const struct timespec *started)
+/***************************************************************************
+*   Description -
+*       Starts the record of a command: argv, redirections, pid and start
+*       time. The rest is added by auditFinish() once it is done.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *stage       - The command (one pipeline stage)
+*       pid_t pid                   - Its process, 0 for a built in
+*       bool backGround             - Run in the background
+*       const struct timespec *started - CLOCK_REALTIME start, NULL for now
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      char *                       - malloc'd record head, NULL when
+*                                     auditing is off
+****************************************************************************/
+{
+    if(audit.fd == -1)
+    {
+        return NULL;
+    }
+    struct timespec now;
+    if(started == NULL)
+    {
+        clock_gettime(CLOCK_REALTIME, &now);
+        started = &now;
+    }
+    char *head = NULL;
+    size_t length = 0;
+    FILE *stream = open_memstream(&head, &length);
+    fputs("{\"argv\":[", stream);
+    for(int x = 0; stage->argv[x] != NULL; x++)
+    {
+        if(x > 0)
+        {
+            fputc(',', stream);
+        }
+        auditString(stream, stage->argv[x]);
+    }
+    fputs("],\"in\":", stream);
+    auditString(stream, stage->inputFile);
+    fputs(",\"out\":", stream);
+    auditString(stream, stage->outputFile);
+    fprintf(stream, ",\"pid\":%d,\"background\":%s,\"start\":%ld.%06ld", 
+            pid, backGround == true ? "true" : "false", (long)started->tv_sec, started->tv_nsec / 1000);
+    fclose(stream);
+    return head;
+}
+
+void auditFinish(char *head, int childStatus)
+/***************************************************************************
+*   Description -
+*       Completes a record with the end time, exit status and signal and
+*       puts it in the ring. Frees head.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       char *head                  - From auditHead(), NULL does nothing
+*       int childStatus             - Wait status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(head == NULL)
+    {
+        return;
+    }
+    if(audit.fd == -1)
+    {
+        free(head);
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    char tail[96];
+    int tailLength;
+    if(WIFEXITED(childStatus))
+    {
+        tailLength = snprintf(tail, sizeof(tail), ",\"end\":%ld.%06ld,\"status\":%d,\"signal\":null}\n",
+                              (long)now.tv_sec, now.tv_nsec / 1000, WEXITSTATUS(childStatus));
+    }
+    else
+    {
+        tailLength = snprintf(tail, sizeof(tail), ",\"end\":%ld.%06ld,\"status\":null,\"signal\":%d}\n",
+                              (long)now.tv_sec, now.tv_nsec / 1000, WTERMSIG(childStatus));
+    }
+    size_t headLength = strlen(head);
+    size_t length = headLength + tailLength;
+    if(length > AUDIT_RING_SIZE - audit.used)
+    {
+        // Make room once, a record bigger than the ring is lost anyway
+        auditFlush();
+    }
+    if(length > AUDIT_RING_SIZE - audit.used)
+    {
+        audit.dropped ++;
+        free(head);
+        return;
+    }
+
+    // Copy in after the waiting bytes, wrapping around the end
+    const char *pieces[2] = {head, tail};
+    size_t sizes[2] = {headLength, tailLength};
+    size_t at = (audit.start + audit.used) % AUDIT_RING_SIZE;
+    for(int x = 0; x < 2; x++)
+    {
+        size_t first = AUDIT_RING_SIZE - at < sizes[x] ? AUDIT_RING_SIZE - at : sizes[x];
+        memcpy(audit.ring + at, pieces[x], first);
+        memcpy(audit.ring, pieces[x] + first, sizes[x] - first);
+        at = (at + sizes[x]) % AUDIT_RING_SIZE;
+    }
+    audit.used += length;
+    audit.waiting ++;
+    audit.records ++;
+    free(head);
+
+    if(audit.used > AUDIT_RING_SIZE / 2)
+    {
+        auditFlush();
+    }
+    else if(audit.armed == false)
+    {
+        audit.armed = startTimer(&audit.timer, AUDIT_FLUSH_DELAY);
+    }
+}
+
+bool auditOpen(const char *path)
+/***************************************************************************
+*   Description -
+*       Starts auditing to path, appending. Any previous log is closed.
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false if path could not be opened
+****************************************************************************/
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd == -1)
+    {
+        return false;
+    }
+    if(audit.fd != -1)
+    {
+        auditFlush();
+        close(audit.fd);
+        free(audit.path);
+    }
+    if(audit.ring == NULL)
+    {
+        audit.ring = malloc(AUDIT_RING_SIZE);
+        audit.timer.ready = auditTimer;
+    }
+    audit.fd = fd;
+    audit.path = strdup(path);
+    return true;
+}
+
+void auditClose(void)
+/***************************************************************************
+*   Description -
+*       Writes what is waiting and stops auditing
+****************************************************************************/
+{
+    if(audit.fd == -1)
+    {
+        return;
+    }
+    auditFlush();
+    stopTimer(&audit.timer);
+    audit.armed = false;
+    close(audit.fd);
+    audit.fd = -1;
+    free(audit.path);
+    audit.path = NULL;
+}
+
+void auditProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The audit command logs every command run from then on to a file
+*       as JSON lines (audit FILE), stops logging (audit -o), or shows 
+*       the log and its counters (audit).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    const char *arguement = ourCommand->arguements[0];
+    if(arguement != NULL && strcmp(arguement, "-o") == 0)
+    {
+        auditClose();
+    }
+    else if(arguement != NULL)
+    {
+        if(auditOpen(arguement) == false)
+        {
+            printf("audit: cannot open %s\n", arguement);
+            *FGS = 1;
+        }
+    }
+    else
+    {
+        printf("audit: %s records %lu dropped %lu waiting %d\n", audit.fd != -1 ? audit.path : "off",
+               audit.records, audit.dropped, audit.waiting);
+    }
+    fflush(stdout);
+}
+
+unsigned int pidSlot(pid_t pid)
+/***************************************************************************
+*   Description -
+*       Home slot of a pid in the pid index (Fibonacci hashing)
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t pid               - Process pid
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      unsigned int             - Slot index
+****************************************************************************/
+{
+    return ((unsigned int)pid * 2654435761u) & (pidCapacity - 1);
+}
+
+void insertPid(pid_t pid, int job)
+/***************************************************************************
+*   Description -
+*       Adds a pid to the pid index, doubling the index at half load
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t pid               - Process pid
+*       int job                 - Slab index of the owning job
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if((pidCount + 1) * 2 > pidCapacity)
+    {
+        struct jobPid *oldTable = pidTable;
+        int oldCapacity = pidCapacity;
+        pidCapacity = pidCapacity == 0 ? 64 : pidCapacity * 2;
+        pidTable = calloc(pidCapacity, sizeof(struct jobPid));
+        pidCount = 0;
+        for(int x = 0; x < oldCapacity; x++)
+        {
+            if(oldTable[x].pid != 0)
+            {
+                insertPid(oldTable[x].pid, oldTable[x].job);
+            }
+        }
+        free(oldTable);
+    }
+    unsigned int slot = pidSlot(pid);
+    while(pidTable[slot].pid != 0)
+    {
+        slot = (slot + 1) & (pidCapacity - 1);
+    }
+    pidTable[slot].pid = pid;
+    pidTable[slot].job = job;
+    pidCount ++;
+}
+
+int findJob(pid_t pid)
+/***************************************************************************
+*   Description -
+*       Looks up the job a process belongs to
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t pid               - Process pid
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Slab index of the job, -1 if none
+****************************************************************************/
+{
+    if(pidCapacity == 0)
+    {
+        return -1;
+    }
+    unsigned int slot = pidSlot(pid);
+    while(pidTable[slot].pid != 0)
+    {
+        if(pidTable[slot].pid == pid)
+        {
+            return pidTable[slot].job;
+        }
+        slot = (slot + 1) & (pidCapacity - 1);
+    }
+    return -1;
+}
+
+void removePid(pid_t pid)
+/***************************************************************************
+*   Description -
+*       Deletes a pid from the pid index. Following entries of the probe 
+*       run are shifted back so lookups never need tombstones.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t pid               - Process pid
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(pidCapacity == 0)
+    {
+        return;
+    }
+    unsigned int mask = pidCapacity - 1;
+    unsigned int slot = pidSlot(pid);
+    while(pidTable[slot].pid != pid)
+    {
+        if(pidTable[slot].pid == 0)
+        {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int hole = slot;
+    unsigned int next = (slot + 1) & mask;
+    while(pidTable[next].pid != 0)
+    {
+        // Move the entry back if the hole lies between its home and itself
+        unsigned int home = pidSlot(pidTable[next].pid);
+        if(((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pidTable[hole] = pidTable[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pidTable[hole].pid = 0;
+    pidCount --;
+}
+
+void startUsage(struct usage *usage)
+/***************************************************************************
+*   Description -
+*       Clears a usage record and starts its wall clock
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct usage *usage     - Record to start
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    memset(usage, 0, sizeof(struct usage));
+    clock_gettime(CLOCK_MONOTONIC, &usage->started);
+}
+
+void addUsage(struct usage *usage, const struct rusage *more)
+/***************************************************************************
+*   Description -
+*       Adds the rusage of one reaped process to a usage record and moves
+*       its wall clock up to now
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct usage *usage     - Record of the command
+*       const struct rusage *more - What wait4() returned for the process
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct rusage *total = &usage->rusage;
+    timeradd(&total->ru_utime, &more->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &more->ru_stime, &total->ru_stime);
+    if(more->ru_maxrss > total->ru_maxrss)
+    {
+        total->ru_maxrss = more->ru_maxrss;
+    }
+    total->ru_minflt += more->ru_minflt;
+    total->ru_majflt += more->ru_majflt;
+    total->ru_nvcsw += more->ru_nvcsw;
+    total->ru_nivcsw += more->ru_nivcsw;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usage->wall = (now.tv_sec - usage->started.tv_sec) + (now.tv_nsec - usage->started.tv_nsec) / 1e9;
+}
+
+void printUsage(FILE *stream, const char *label, struct usage *usage)
+/***************************************************************************
+*   Description -
+*       Prints a usage record on one line:
+*       label real 0.000s user 0.000s sys 0.000s maxrss 0kB csw 0/0 [text]
+*       csw is voluntary/involuntary context switches
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       FILE *stream            - Where to print
+*       const char *label       - First word of the line
+*       struct usage *usage     - Record to print
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct rusage *total = &usage->rusage;
+    fprintf(stream, "%s real %.3fs user %ld.%03lds sys %ld.%03lds maxrss %ldkB csw %ld/%ld%s%s\n",
+            label, usage->wall,
+            (long)total->ru_utime.tv_sec, (long)total->ru_utime.tv_usec / 1000,
+            (long)total->ru_stime.tv_sec, (long)total->ru_stime.tv_usec / 1000,
+            total->ru_maxrss, total->ru_nvcsw, total->ru_nivcsw,
+            usage->text != NULL ? "  " : "", usage->text != NULL ? usage->text : "");
+}
+
+int addJob(pid_t *pids, int count, char *text)
+/***************************************************************************
+*   Description -
+*       Records a new background job, reusing a free record if possible
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t *pids             - Processes of the job, last stage last
+*       int count               - Number of processes
+*       char *text              - malloc'd command line, owned by the job
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Job id
+****************************************************************************/
+{
+    if(jobFree == -1)
+    {
+        int oldCapacity = jobCapacity;
+        jobCapacity = jobCapacity == 0 ? 16 : jobCapacity * 2;
+        jobSlab = realloc(jobSlab, jobCapacity * sizeof(struct job));
+        // Chain the new records so the lowest index is handed out first
+        for(int x = jobCapacity - 1; x >= oldCapacity; x--)
+        {
+            jobSlab[x].used = false;
+            jobSlab[x].nextFree = jobFree;
+            jobFree = x;
+        }
+    }
+
+    int index = jobFree;
+    struct job *newJob = &jobSlab[index];
+    jobFree = newJob->nextFree;
+    newJob->used = true;
+    newJob->pids = malloc(count * sizeof(pid_t));
+    memcpy(newJob->pids, pids, count * sizeof(pid_t));
+    newJob->count = count;
+    newJob->running = count;
+    newJob->lastStatus = 0;
+    newJob->stopped = false;
+    newJob->text = text;
+    newJob->audit = NULL;
+    startUsage(&newJob->usage);
+    for(int x = 0; x < count; x++)
+    {
+        insertPid(pids[x], index);
+    }
+    jobsRunning ++;
+    lastJob = index + 1;
+    return index + 1;
+}
+
+void removeJob(int index)
+/***************************************************************************
+*   Description -
+*       Forgets a job and returns its record to the free list
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int index               - Slab index of the job
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct job *oldJob = &jobSlab[index];
+    for(int x = 0; x < oldJob->count; x++)
+    {
+        removePid(oldJob->pids[x]);
+    }
+    if(oldJob->stopped == false)
+    {
+        jobsRunning --;
+    }
+    if(oldJob->audit != NULL)
+    {
+        for(int x = 0; x < oldJob->count; x++)
+        {
+            free(oldJob->audit[x]);
+        }
+        free(oldJob->audit);
+    }
+    free(oldJob->pids);
+    free(oldJob->text);
+    oldJob->used = false;
+    oldJob->nextFree = jobFree;
+    jobFree = index;
+}
+
+// Background job output (joboutput built in). Jobs write into a pipe per 
+// job that the event loop reads, at most JOB_OUTPUT_LIMIT bytes wait per job
+#define JOB_OUTPUT_OFF 0            // Jobs write to the shell's stdout
+#define JOB_OUTPUT_LINES 1          // Whole lines, each with a [id] prefix
+#define JOB_OUTPUT_GROUP 2          // All of a job's output together
+#define JOB_OUTPUT_LIMIT 65536
+int jobOutputMode = JOB_OUTPUT_OFF;
+
+struct jobOutput
+/**************************************************************************
+*   Description -
+*       Output of one background job, read from its pipe by the event loop
+*       into a buffer of JOB_OUTPUT_LIMIT bytes. Lines mode prints whole
+*       lines as they complete. Group mode prints a job's output in one 
+*       piece when it ends; a job that fills its buffer first streams 
+*       the rest if no other job is streaming, otherwise it is no longer
+*       read (its writes block) until that job is done.
+*   -----------------------------------------------------------------------
+*    struct eventSource source  - Read end of the pipe, data is the output
+*    int mode                   - JOB_OUTPUT_LINES or JOB_OUTPUT_GROUP
+*    int id                     - Job id shown with the output
+*    char *text                 - Command line, shown above a group
+*    char *data                 - Buffered output
+*    size_t length              - Bytes in data
+*    bool started               - Group header printed, output streams
+*    bool paused                - Full and not watched (backpressure)
+*    bool done                  - The pipe is closed, waiting its turn
+*    struct jobOutput *next     - Next output, oldest job first
+*
+***************************************************************************/
+{
+    struct eventSource source;
+    int mode;
+    int id;
+    char *text;
+    char *data;
+    size_t length;
+    bool started;
+    bool paused;
+    bool done;
+    struct jobOutput *next;
+};
+struct jobOutput *jobOutputs = NULL;
+struct jobOutput *streamingOutput = NULL;   // Group mode: job printing now
+
+// While a prompt is showing, the first output starts a new line and the
+// prompt is redrawn afterwards (waitForInput)
+bool outputAtPrompt = false;
+bool outputShown = false;
+
+void showOutput(const char *data, size_t length)
+/***************************************************************************
+*   Description -
+*       Writes job output to stdout, breaking the line of a prompt first
+****************************************************************************/
+{
+    if(outputAtPrompt == true && outputShown == false)
+    {
+        putchar('\n');
+        outputShown = true;
+    }
+    fwrite(data, 1, length, stdout);
+}
+
+void showLines(struct jobOutput *output, bool all)
+/***************************************************************************
+*   Description -
+*       Lines mode: prints every complete buffered line with its [id] 
+*       prefix and keeps the partial one. With all, a partial line is 
+*       printed too (full buffer or end of output).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct jobOutput *output    - Job output
+*       bool all                    - Print a partial line as well
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char prefix[24];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "[%d] ", output->id);
+    size_t start = 0;
+    char *newline;
+    while((newline = memchr(output->data + start, '\n', output->length - start)) != NULL)
+    {
+        size_t end = newline + 1 - output->data;
+        showOutput(prefix, prefixLength);
+        showOutput(output->data + start, end - start);
+        start = end;
+    }
+    if(all == true && start < output->length)
+    {
+        showOutput(prefix, prefixLength);
+        showOutput(output->data + start, output->length - start);
+        showOutput("\n", 1);
+        start = output->length;
+    }
+    memmove(output->data, output->data + start, output->length - start);
+    output->length -= start;
+}
+
+void showGroup(struct jobOutput *output, bool all)
+/***************************************************************************
+*   Description -
+*       Group mode: prints the complete buffered lines, under a [id] 
+*       command line header the first time. A job with no output shows 
+*       nothing.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct jobOutput *output    - Job output
+*       bool all                    - End of output, print and end a 
+*                                     partial line as well
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    size_t end = output->length;
+    while(all == false && end > 0 && output->data[end - 1] != '\n')
+    {
+        end --;
+    }
+    // A full buffer without a newline can't wait for one
+    if(end == 0 && output->length == JOB_OUTPUT_LIMIT)
+    {
+        end = output->length;
+    }
+    if(end == 0)
+    {
+        return;
+    }
+    if(output->started == false)
+    {
+        char header[32];
+        showOutput(header, snprintf(header, sizeof(header), "[%d] ", output->id));
+        showOutput(output->text, strlen(output->text));
+        showOutput("\n", 1);
+        output->started = true;
+    }
+    showOutput(output->data, end);
+    if(all == true && output->data[end - 1] != '\n')
+    {
+        showOutput("\n", 1);
+    }
+    memmove(output->data, output->data + end, output->length - end);
+    output->length -= end;
+}
+
+void freeJobOutput(struct jobOutput *output)
+/***************************************************************************
+*   Description -
+*       Takes an output off jobOutputs and frees it. Its pipe is closed
+*       already unless the shell is exiting.
+****************************************************************************/
+{
+    struct jobOutput **link = &jobOutputs;
+    while(*link != output)
+    {
+        link = &(*link)->next;
+    }
+    *link = output->next;
+    if(output->source.fd != -1)
+    {
+        if(output->paused == false)
+        {
+            unwatchEvents(&output->source);
+        }
+        close(output->source.fd);
+    }
+    free(output->text);
+    free(output->data);
+    free(output);
+}
+
+void nextGroup(void)
+/***************************************************************************
+*   Description -
+*       Group mode, once no job is streaming: prints the groups of jobs 
+*       that ended meanwhile, oldest first, then lets the oldest job with
+*       a full buffer stream and reads it again
+****************************************************************************/
+{
+    struct jobOutput *output = jobOutputs;
+    while(streamingOutput == NULL && output != NULL)
+    {
+        struct jobOutput *next = output->next;
+        if(output->done == true)
+        {
+            showGroup(output, true);
+            freeJobOutput(output);
+        }
+        else if(output->paused == true)
+        {
+            streamingOutput = output;
+            showGroup(output, false);
+            output->paused = false;
+            watchEvents(&output->source, EPOLLIN);
+        }
+        output = next;
+    }
+}
+
+void endJobOutput(struct jobOutput *output)
+/***************************************************************************
+*   Description -
+*       Every writer has closed the pipe: prints what is left (in group
+*       mode when it is the job's turn) and frees the output
+****************************************************************************/
+{
+    unwatchEvents(&output->source);
+    close(output->source.fd);
+    output->source.fd = -1;
+    output->done = true;
+    if(output->mode == JOB_OUTPUT_LINES)
+    {
+        showLines(output, true);
+        freeJobOutput(output);
+    }
+    else if(streamingOutput == NULL || streamingOutput == output)
+    {
+        showGroup(output, true);
+        streamingOutput = NULL;
+        freeJobOutput(output);
+        nextGroup();
+    }
+}
+
+void readJobOutput(struct eventSource *source, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Ready handler of a job's pipe. One read per event into the room 
+*       left in the buffer, so no job starves the others.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Pipe, data is the struct jobOutput
+*       uint32_t events             - Unused
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct jobOutput *output = source->data;
+    ssize_t count = read(source->fd, output->data + output->length, JOB_OUTPUT_LIMIT - output->length);
+    if(count == -1 && (errno == EAGAIN || errno == EINTR))
+    {
+        return;
+    }
+    if(count <= 0)
+    {
+        endJobOutput(output);
+        fflush(stdout);
+        return;
+    }
+    output->length += count;
+
+    if(output->mode == JOB_OUTPUT_LINES)
+    {
+        showLines(output, output->length == JOB_OUTPUT_LIMIT);
+    }
+    else
+    {
+        if(streamingOutput == NULL && output->length == JOB_OUTPUT_LIMIT)
+        {
+            streamingOutput = output;
+        }
+        if(streamingOutput == output)
+        {
+            showGroup(output, false);
+        }
+        else if(output->length == JOB_OUTPUT_LIMIT)
+        {
+            // Full, the job blocks on its pipe until its turn comes
+            unwatchEvents(source);
+            output->paused = true;
+        }
+    }
+    fflush(stdout);
+}
+
+struct jobOutput *newJobOutput(int *writeFD)
+/***************************************************************************
+*   Description -
+*       Makes the pipe for a background job's output when joboutput is 
+*       on. The write end is the job's stdout and stderr, the caller 
+*       closes it once the job has started.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int *writeFD                - Set to the write end, -1 when off
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct jobOutput *           - Output for attachJobOutput(), NULL 
+*                                     when off
+****************************************************************************/
+{
+    int outputPipe[2];
+    *writeFD = -1;
+    if(jobOutputMode == JOB_OUTPUT_OFF || pipe2(outputPipe, O_CLOEXEC) == -1)
+    {
+        return NULL;
+    }
+    // Only our end is non-blocking, the job writes as usual
+    fcntl(outputPipe[0], F_SETFL, O_NONBLOCK);
+    struct jobOutput *output = calloc(1, sizeof(struct jobOutput));
+    output->source.fd = outputPipe[0];
+    output->source.ready = readJobOutput;
+    output->source.data = output;
+    output->mode = jobOutputMode;
+    output->data = malloc(JOB_OUTPUT_LIMIT);
+    *writeFD = outputPipe[1];
+    return output;
+}
+
+void attachJobOutput(struct jobOutput *output, int job)
+/***************************************************************************
+*   Description -
+*       Starts reading a job's output once it is in the job table. Without
+*       a job (nothing started) the output is dropped.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct jobOutput *output    - From newJobOutput(), may be NULL
+*       int job                     - Job id, 0 if there is no job
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(output == NULL)
+    {
+        return;
+    }
+    if(job == 0)
+    {
+        close(output->source.fd);
+        free(output->data);
+        free(output);
+        return;
+    }
+    struct jobOutput **last = &jobOutputs;
+    while(*last != NULL)
+    {
+        last = &(*last)->next;
+    }
+    *last = output;
+    output->id = job;
+    output->text = strdup(jobSlab[job - 1].text);
+    watchEvents(&output->source, EPOLLIN);
+}
+
+void flushJobOutputs(void)
+/***************************************************************************
+*   Description -
+*       On exit: reads what the jobs left in their pipes and prints all
+*       of it, groups in order
+****************************************************************************/
+{
+    streamingOutput = NULL;
+    while(jobOutputs != NULL)
+    {
+        struct jobOutput *output = jobOutputs;
+        ssize_t count = 1;
+        while(output->source.fd != -1 && output->length < JOB_OUTPUT_LIMIT &&
+              (count = read(output->source.fd, output->data + output->length, JOB_OUTPUT_LIMIT - output->length)) > 0)
+        {
+            output->length += count;
+            if(output->length == JOB_OUTPUT_LIMIT && output->mode == JOB_OUTPUT_LINES)
+            {
+                showLines(output, true);
+            }
+            else if(output->length == JOB_OUTPUT_LIMIT)
+            {
+                showGroup(output, false);
+            }
+        }
+        if(output->mode == JOB_OUTPUT_LINES)
+        {
+            showLines(output, true);
+        }
+        else
+        {
+            showGroup(output, true);
+        }
+        freeJobOutput(output);
+    }
+    fflush(stdout);
+}
+
+int jobIndex(struct command *ourCommand, const char *name)
+/***************************************************************************
+*   Description -
+*       Picks the job a job control built in refers to: the job id given
+*       as first arguement, otherwise the most recent live job
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       const char *name                - Built in name for messages
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                              - Slab index, -1 if no such job
+****************************************************************************/
+{
+    int id = lastJob;
+    if(ourCommand->arguements[0] != NULL)
+    {
+        char *argument = ourCommand->arguements[0];
+        id = atoi(argument[0] == '%' ? argument + 1 : argument);
+    }
+    else if(id < 1 || id > jobCapacity || jobSlab[id-1].used == false)
+    {
+        // Most recent job is gone, fall back to the highest live id
+        id = 0;
+        for(int x = jobCapacity - 1; x >= 0; x--)
+        {
+            if(jobSlab[x].used == true)
+            {
+                id = x + 1;
+                break;
+            }
+        }
+    }
+    if(id < 1 || id > jobCapacity || jobSlab[id-1].used == false)
+    {
+        printf("%s: no such job\n", name);
+        fflush(stdout);
+        return -1;
+    }
+    return id - 1;
+}
+
+bool collectProcess(pid_t pid, int childStatus, const struct rusage *childUsage, bool report)
+/***************************************************************************
+*   Description -
+*       Applies a wait4() result to the job table. Exited processes are
+*       reported and removed, a job is freed once all of its processes are
+*       gone and its usage kept for status -v. Stops and continues only 
+*       update the job state.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t pid               - Pid returned by wait4()
+*       int childStatus         - Status returned by wait4()
+*       const struct rusage *childUsage - Usage returned by wait4()
+*       bool report             - Print the exit message
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - true if the pid belonged to a job
+****************************************************************************/
+{
+    int index = findJob(pid);
+    if(index == -1)
+    {
+        return false;
+    }
+    struct job *ourJob = &jobSlab[index];
+
+    if(WIFSTOPPED(childStatus))
+    {
+        if(ourJob->stopped == false)
+        {
+            ourJob->stopped = true;
+            jobsRunning --;
+        }
+        if(report == true)
+        {
+            printf("[%d] Stopped %s\n", index + 1, ourJob->text);
+        }
+        return true;
+    }
+    if(WIFCONTINUED(childStatus))
+    {
+        if(ourJob->stopped == true)
+        {
+            ourJob->stopped = false;
+            jobsRunning ++;
+        }
+        return true;
+    }
+
+    if(report == true)
+    {
+        if(WIFEXITED(childStatus))
+        {
+            printf("Child %d exited normally with status %d\n", pid, WEXITSTATUS(childStatus));
+        } else
+        {
+            printf("Child %d exited abnormally due to signal %d\n", pid, WTERMSIG(childStatus));
+        }
+    }
+    if(pid == ourJob->pids[ourJob->count - 1])
+    {
+        ourJob->lastStatus = childStatus;
+    }
+    for(int x = 0; ourJob->audit != NULL && x < ourJob->count; x++)
+    {
+        if(ourJob->pids[x] == pid)
+        {
+            auditFinish(ourJob->audit[x], childStatus);
+            ourJob->audit[x] = NULL;
+        }
+    }
+    addUsage(&ourJob->usage, childUsage);
+    removePid(pid);
+    ourJob->running --;
+    if(ourJob->running == 0)
+    {
+        // Keep the finished job's usage, taking over its command line
+        free(jobUsage.text);
+        jobUsage = ourJob->usage;
+        jobUsage.text = ourJob->text;
+        ourJob->text = NULL;
+        removeJob(index);
+    }
+    return true;
+}
+
+bool reapProcesses(bool atPrompt)
+/***************************************************************************
+*   Description -
+*       Collects every child that has changed state since the last call 
+*       with wait4(-1, WNOHANG), one call per child plus the final empty 
+*       one, and reports the background processes among them. Does 
+*       nothing (no syscalls) when SIGCHLD has not fired.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       bool atPrompt               - A prompt is showing, start a new line
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - true if a message was printed
+****************************************************************************/
+{
+    if(childExited == 0)
+    {
+        return false;
+    }
+    childExited = false;
+
+    bool printed = false;
+    int childStatus;
+    struct rusage childUsage;
+    pid_t PID;
+    while((PID = wait4(-1, &childStatus, WNOHANG | WUNTRACED | WCONTINUED, &childUsage)) > 0)
+    {
+        // Not a background process of ours
+        if(findJob(PID) == -1)
+        {
+            continue;
+        }
+        if(printed == false && atPrompt == true && WIFCONTINUED(childStatus) == 0)
+        {
+            printf("\n");
+            printed = true;
+        }
+        collectProcess(PID, childStatus, &childUsage, true);
+    }
+    fflush(stdout);
+    return printed;
+}
+
+void openReader(struct lineReader *reader, int fd)
+/***************************************************************************
+*   Description -
+*       Sets up a reader on fd, mapping it when it is a regular file
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Reader to initialize
+*       int fd                      - Input descriptor
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    memset(reader, 0, sizeof(struct lineReader));
+    reader->fd = fd;
+
+    struct stat info;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped != MAP_FAILED)
+        {
+            madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+            reader->data = mapped;
+            reader->filled = info.st_size;
+            reader->eof = true;
+            return;
+        }
+    }
+
+    reader->capacity = 65536;
+    reader->data = malloc(reader->capacity);
+}
+
+bool lineBuffered(struct lineReader *reader)
+/***************************************************************************
+*   Description -
+*       Checks whether readLine() can return without reading
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Reader to check
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - true if a whole line is buffered
+****************************************************************************/
+{
+    return reader->eof == true ||
+           memchr(reader->data + reader->start, '\n', reader->filled - reader->start) != NULL;
+}
+
+bool readLine(struct lineReader *reader, const char **line, size_t *length)
+/***************************************************************************
+*   Description -
+*       Hands out the next line without its newline. The line stays valid
+*       until the next call. A last line without a newline is returned 
+*       as well.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Reader to take the line from
+*       const char **line           - Set to the start of the line
+*       size_t *length              - Set to the length of the line
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false at end of input
+****************************************************************************/
+{
+    size_t searched = reader->start;
+    while(true)
+    {
+        char *newline = memchr(reader->data + searched, '\n', reader->filled - searched);
+        if(newline != NULL)
+        {
+            *line = reader->data + reader->start;
+            *length = newline - *line;
+            reader->start = newline + 1 - reader->data;
+            return true;
+        }
+        if(reader->eof == true)
+        {
+            if(reader->start == reader->filled)
+            {
+                return false;
+            }
+            *line = reader->data + reader->start;
+            *length = reader->filled - reader->start;
+            reader->start = reader->filled;
+            return true;
+        }
+
+        // Keep the partial line, make room behind it and read more
+        size_t partial = reader->filled - reader->start;
+        memmove(reader->data, reader->data + reader->start, partial);
+        reader->start = 0;
+        reader->filled = partial;
+        searched = partial;
+        if(reader->filled == reader->capacity)
+        {
+            reader->capacity *= 2;
+            reader->data = realloc(reader->data, reader->capacity);
+        }
+        ssize_t count = read(reader->fd, reader->data + reader->filled, reader->capacity - reader->filled);
+        if(count > 0)
+        {
+            reader->filled += count;
+        }
+        else if(count == 0 || errno != EINTR)
+        {
+            reader->eof = true;
+        }
+    }
+}
+
+void closeReader(struct lineReader *reader)
+/***************************************************************************
+*   Description -
+*       Releases a reader's mapping or buffer and closes its descriptor
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Reader from openReader()
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(reader->capacity == 0)
+    {
+        munmap(reader->data, reader->filled);
+    }
+    else
+    {
+        free(reader->data);
+    }
+    close(reader->fd);
+}
+
+void inputReady(struct eventSource *source, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Ready handler of the input source, waitForInput() stops on it
+****************************************************************************/
+{
+    source->data = source;
+}
+
+struct eventSource inputSource = {-1, inputReady, NULL};
+
+void waitForInput(int fd, void (*redraw)(void))
+/***************************************************************************
+*   Description -
+*       Runs the event loop until the input is readable, reporting 
+*       background processes the moment they finish and foreground-only
+*       mode changes the moment they are asked for, then redrawing the
+*       prompt. The input is watched one shot so it never wakes the loop
+*       while a command runs. Only used when prompting.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int fd                      - Input descriptor
+*       void (*redraw)(void)        - Puts the prompt back after a message
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    // Idle until the next line, a good time to write the audit log
+    auditFlush();
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = &inputSource;
+    int operation = inputSource.fd == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    inputSource.fd = fd;
+    // Regular files cannot be watched, and never need waiting for
+    if(epoll_ctl(eventFD, operation, fd, &event) == -1)
+    {
+        return;
+    }
+    inputSource.data = NULL;
+    while(inputSource.data == NULL)
+    {
+        // Job output printed over the prompt starts its own line
+        outputAtPrompt = true;
+        runEvents(-1);
+        outputAtPrompt = false;
+        bool shown = outputShown;
+        outputShown = false;
+        bool printed = reapProcesses(shown == false) || shown == true;
+        if(reportStops() == true || printed == true)
+        {
+            redraw();
+        }
+    }
+}
+
+void printPrompt(void)
+/***************************************************************************
+*   Description -
+*       Prints the prompt
+****************************************************************************/
+{
+    printf(": ");
+    fflush(stdout);
+}
+
+struct history
+/**************************************************************************
+*   Description -
+*       Command history, kept in an append-only file. Lines are appended
+*       with one write() each. Reading maps the file and indexes it 
+*       lazily, only when a history lookup needs it, so starting the 
+*       shell costs the same however long the history is.
+*
+*       The index keeps the offset of every line plus, for each pair of 
+*       leading bytes, a chain from the newest entry starting with them to
+*       older ones, so !prefix only looks at entries that could match.
+*   -----------------------------------------------------------------------
+*    int fd                 - History file, -1 when history is off
+*    char *data             - Mapping of the file
+*    size_t mapped          - Length of the mapping
+*    size_t indexed         - Bytes of the file covered by the index
+*    size_t *lines          - Offset of each entry, entry n is lines[n-1]
+*    int *samePrefix        - Next older entry with the same two bytes
+*    int count              - Entries indexed
+*    int capacity           - Room in lines and samePrefix
+*    int *prefixHead        - Newest entry for each two leading bytes
+*
+***************************************************************************/
+{
+    int fd;
+    char *data;
+    size_t mapped;
+    size_t indexed;
+    size_t *lines;
+    int *samePrefix;
+    int count;
+    int capacity;
+    int *prefixHead;
+};
+
+struct history commandHistory = {-1};
+
+void openHistory(void)
+/***************************************************************************
+*   Description -
+*       Opens the history file, $HISTFILE or ~/.smallsh_history, for 
+*       appending. Nothing is read until a lookup needs it. An empty
+*       HISTFILE turns history off.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char path[4096];
+    const char *file = getenv("HISTFILE");
+    if(file == NULL)
+    {
+        const char *home = getenv("HOME");
+        if(home == NULL)
+        {
+            return;
+        }
+        snprintf(path, sizeof(path), "%s/.smallsh_history", home);
+        file = path;
+    }
+    if(file[0] == '\0')
+    {
+        return;
+    }
+    commandHistory.fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
+
+void addHistory(const char *line, size_t length)
+/***************************************************************************
+*   Description -
+*       Appends a line to the history file
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *line        - Line, no newline
+*       size_t length           - Length of line
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(commandHistory.fd == -1)
+    {
+        return;
+    }
+    struct iovec parts[2] = {{(void *)line, length}, {"\n", 1}};
+    writev(commandHistory.fd, parts, 2);
+}
+
+int prefixKey(const char *line, size_t length)
+/***************************************************************************
+*   Description -
+*       Bucket of the prefix chains: the first two bytes of a line
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *line        - Line or prefix
+*       size_t length           - Length, at least 1
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Key in 0 ... 65535
+****************************************************************************/
+{
+    return (unsigned char)line[0] << 8 | (length > 1 ? (unsigned char)line[1] : 0);
+}
+
+bool syncHistory(void)
+/***************************************************************************
+*   Description -
+*       Brings the mapping and index up to the current end of the history
+*       file, covering lines this shell and any other appended since the
+*       last lookup. Only the new bytes are scanned.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - false if history is unavailable
+****************************************************************************/
+{
+    struct stat info;
+    if(commandHistory.fd == -1 || fstat(commandHistory.fd, &info) == -1)
+    {
+        return false;
+    }
+    size_t size = info.st_size;
+    if(size > commandHistory.mapped)
+    {
+        // Map ahead so appends rarely need a new mapping
+        size_t length = (size + (1 << 20)) & ~(size_t)((1 << 20) - 1);
+        if(commandHistory.data != NULL)
+        {
+            munmap(commandHistory.data, commandHistory.mapped);
+        }
+        commandHistory.data = mmap(NULL, length, PROT_READ, MAP_SHARED, commandHistory.fd, 0);
+        if(commandHistory.data == MAP_FAILED)
+        {
+            commandHistory.data = NULL;
+            commandHistory.mapped = 0;
+            return false;
+        }
+        commandHistory.mapped = length;
+    }
+    if(commandHistory.prefixHead == NULL)
+    {
+        commandHistory.prefixHead = malloc(65536 * sizeof(int));
+        memset(commandHistory.prefixHead, -1, 65536 * sizeof(int));
+    }
+
+    // Index every complete line not seen yet
+    char *data = commandHistory.data;
+    while(commandHistory.indexed < size)
+    {
+        size_t start = commandHistory.indexed;
+        char *newline = memchr(data + start, '\n', size - start);
+        if(newline == NULL)
+        {
+            break;
+        }
+        commandHistory.indexed = newline + 1 - data;
+        if(newline == data + start)
+        {
+            continue;
+        }
+        if(commandHistory.count == commandHistory.capacity)
+        {
+            commandHistory.capacity = commandHistory.capacity == 0 ? 4096 : commandHistory.capacity * 2;
+            commandHistory.lines = realloc(commandHistory.lines, commandHistory.capacity * sizeof(size_t));
+            commandHistory.samePrefix = realloc(commandHistory.samePrefix, commandHistory.capacity * sizeof(int));
+        }
+        int key = prefixKey(data + start, newline - (data + start));
+        commandHistory.lines[commandHistory.count] = start;
+        commandHistory.samePrefix[commandHistory.count] = commandHistory.prefixHead[key];
+        commandHistory.prefixHead[key] = commandHistory.count;
+        commandHistory.count ++;
+    }
+    return true;
+}
+
+size_t historyEntry(int index, const char **line)
+/***************************************************************************
+*   Description -
+*       Finds an indexed history entry
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int index               - Entry number - 1
+*       const char **line       - Set to the entry, inside the mapping
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      size_t                   - Length of the entry
+****************************************************************************/
+{
+    size_t start = commandHistory.lines[index];
+    *line = commandHistory.data + start;
+    size_t end = index + 1 < commandHistory.count ? commandHistory.lines[index + 1] : commandHistory.indexed;
+    // Skip back over the newline and any empty lines that followed it
+    while(end > start && commandHistory.data[end - 1] == '\n')
+    {
+        end --;
+    }
+    return end - start;
+}
+
+int findHistory(const char *prefix, size_t length)
+/***************************************************************************
+*   Description -
+*       Finds the newest history entry starting with prefix, walking only
+*       the chain of entries that share its first two bytes
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *prefix      - Prefix to look for
+*       size_t length           - Length of prefix, at least 1
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Entry number - 1, -1 if none
+****************************************************************************/
+{
+    const char *line;
+    if(length == 1)
+    {
+        for(int index = commandHistory.count - 1; index >= 0; index--)
+        {
+            if(commandHistory.data[commandHistory.lines[index]] == prefix[0])
+            {
+                return index;
+            }
+        }
+        return -1;
+    }
+    for(int index = commandHistory.prefixHead[prefixKey(prefix, length)]; index != -1; index = commandHistory.samePrefix[index])
+    {
+        if(historyEntry(index, &line) >= length && memcmp(line, prefix, length) == 0)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+int historyAt(size_t offset, int low)
+/***************************************************************************
+*   Description -
+*       Finds the entry holding a byte of the mapping by binary search 
+*       over the entry offsets
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       size_t offset           - Byte of the mapping, inside the index
+*       int low                 - No entry before this one can hold it
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Entry number - 1
+****************************************************************************/
+{
+    int high = commandHistory.count - 1;
+    while(low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if(commandHistory.lines[middle] <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+int findHistoryText(const char *text, size_t length, int before)
+/***************************************************************************
+*   Description -
+*       Finds the newest entry older than before containing text. The 
+*       mapping is searched backwards in chunks of whole entries with 
+*       memmem(), text holds no newline so a match never spans entries.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *text        - Text to look for
+*       size_t length           - Length of text, at least 1
+*       int before              - Entry number - 1 to search before
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Entry number - 1, -1 if none
+****************************************************************************/
+{
+    const char *data = commandHistory.data;
+    size_t end = before < commandHistory.count ? commandHistory.lines[before] : commandHistory.indexed;
+    while(end > 0)
+    {
+        size_t start = commandHistory.lines[historyAt(end > 65536 ? end - 65536 : 0, 0)];
+        const char *found = NULL;
+        const char *next = data + start;
+        while((next = memmem(next, data + end - next, text, length)) != NULL)
+        {
+            found = next;
+            next ++;
+        }
+        if(found != NULL)
+        {
+            return historyAt(found - data, 0);
+        }
+        end = start;
+    }
+    return -1;
+}
+
+bool expandHistory(const char **line, size_t *length)
+/***************************************************************************
+*   Description -
+*       Replaces a line starting with ! by a history entry: !! is the 
+*       last entry, !N entry N and !prefix the newest entry starting with
+*       prefix. The expanded line is echoed like other shells do.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char **line       - Line, replaced by the entry
+*       size_t *length          - Length, replaced by the entry's
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - false if there is no such entry
+****************************************************************************/
+{
+    const char *event = *line + 1;
+    size_t eventLength = *length - 1;
+    while(eventLength > 0 && event[eventLength - 1] == ' ')
+    {
+        eventLength --;
+    }
+    int index = -1;
+    if(eventLength > 0 && syncHistory() == true)
+    {
+        if(eventLength == 1 && event[0] == '!')
+        {
+            index = commandHistory.count - 1;
+        }
+        else if(isdigit((unsigned char)event[0]))
+        {
+            index = atoi(event) - 1;
+            index = index < commandHistory.count ? index : -1;
+        }
+        else
+        {
+            index = findHistory(event, eventLength);
+        }
+    }
+    if(index < 0)
+    {
+        printf("%.*s: event not found\n", (int)*length, *line);
+        fflush(stdout);
+        return false;
+    }
+    *length = historyEntry(index, line);
+    printf("%.*s\n", (int)*length, *line);
+    fflush(stdout);
+    return true;
+}
+
+void historyProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The history command lists the command history with entry numbers.
+*
+*       'history N' lists only the last N entries. 'history -s text' 
+*       lists every entry containing text, found with memmem() over the
+*       whole mapping rather than entry by entry.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(syncHistory() == false)
+    {
+        printf("history: no history file\n");
+        fflush(stdout);
+        return;
+    }
+    char **arguement = ourCommand->arguements;
+    const char *line;
+    size_t length;
+
+    if(arguement[0] != NULL && strcmp(arguement[0], "-s") == 0 && arguement[1] != NULL)
+    {
+        const char *text = arguement[1];
+        size_t textLength = strlen(text);
+        const char *data = commandHistory.data;
+        const char *end = data + commandHistory.indexed;
+        const char *found = data;
+        int index = 0;
+        while((found = memmem(found, end - found, text, textLength)) != NULL)
+        {
+            // Entry holding the match, searching on from the last one
+            index = historyAt(found - data, index);
+            length = historyEntry(index, &line);
+            if(found + textLength <= line + length)
+            {
+                printf("%5d  %.*s\n", index + 1, (int)length, line);
+            }
+            // Continue after this entry, one match per entry
+            found = line + length;
+            index ++;
+            if(index >= commandHistory.count)
+            {
+                break;
+            }
+        }
+        fflush(stdout);
+        return;
+    }
+
+    int first = 0;
+    if(arguement[0] != NULL && atoi(arguement[0]) > 0 && atoi(arguement[0]) < commandHistory.count)
+    {
+        first = commandHistory.count - atoi(arguement[0]);
+    }
+    for(int index = first; index < commandHistory.count; index++)
+    {
+        length = historyEntry(index, &line);
+        printf("%5d  %.*s\n", index + 1, (int)length, line);
+    }
+    fflush(stdout);
+}
+
+bool jobsLeft(void)
+/***************************************************************************
+*   Description -
+*       Whether the job table still holds a job, running or stopped
+****************************************************************************/
+{
+    for(int x = 0; x < jobCapacity; x++)
+    {
+        if(jobSlab[x].used == true)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int waitGroups(pid_t *group, int groups, double seconds)
+/***************************************************************************
+*   Description -
+*       Waits up to seconds for every process of the given process groups
+*       to be gone, reaping children (ours, and orphans re-parented to 
+*       the shell) quietly as SIGCHLD comes in through the event loop.
+*       Group members that are nobody's child of ours cannot wake the 
+*       loop, those are checked on every 10ms once no job is left.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       pid_t *group                - Group ids, compacted to those left
+*       int groups                  - Number of groups
+*       double seconds              - Longest wait
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                          - Groups that still have processes
+****************************************************************************/
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double deadline = now.tv_sec + now.tv_nsec / 1e9 + seconds;
+    while(groups > 0)
+    {
+        int childStatus;
+        struct rusage childUsage;
+        pid_t PID;
+        while((PID = wait4(-1, &childStatus, WNOHANG, &childUsage)) > 0)
+        {
+            collectProcess(PID, childStatus, &childUsage, false);
+        }
+        int left = 0;
+        for(int x = 0; x < groups; x++)
+        {
+            if(kill(-group[x], 0) == 0)
+            {
+                group[left++] = group[x];
+            }
+        }
+        groups = left;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double remaining = deadline - (now.tv_sec + now.tv_nsec / 1e9);
+        if(groups == 0 || remaining <= 0)
+        {
+            break;
+        }
+        int timeout = (int)(remaining * 1000) + 1;
+        if(jobsLeft() == false && timeout > 10)
+        {
+            timeout = 10;
+        }
+        runEvents(timeout);
+    }
+    return groups;
+}
+
+void exitProcess(void)
+/***************************************************************************
+*   Description -
+*       Exits our shell. It takes no arguments. When this command is run, 
+*       our shell will kill any other processes or jobs that our shell has 
+*       started before it terminates itself.
+*
+*       Every job is a process group, so one SIGTERM per job also reaches
+*       the processes it started. The shell then waits for all of them at
+*       once for up to the grace period (timeout -k), SIGKILLs the groups
+*       that are left and reaps what they leave behind.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      Breaks from loop to free() structures and EXITS program
+****************************************************************************/
+    {
+        int groups = 0;
+        pid_t *group = malloc((jobCapacity + 1) * sizeof(pid_t));
+        for(int x = 0; x < jobCapacity; x++)
+        {
+            if(jobSlab[x].used == true)
+            {
+                // pids[0] leads the job's group, stopped jobs must run to die
+                group[groups] = jobSlab[x].pids[0];
+                kill(-group[groups], SIGTERM);
+                kill(-group[groups], SIGCONT);
+                groups ++;
+            }
+        }
+
+        groups = waitGroups(group, groups, defaultGrace);
+        for(int x = 0; x < groups; x++)
+        {
+            kill(-group[x], SIGKILL);
+        }
+        // SIGKILL can't be caught, this is only as long as the kernel takes
+        waitGroups(group, groups, 1);
+        free(group);
+
+        // Whatever the jobs wrote last is still waiting in their pipes
+        flushJobOutputs();
+    }
+
+void cdProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The cd command changes the working directory of smallsh.
+*
+*       By itself - with no arguments - it changes to the directory specified 
+*       in the HOME environment variable
+*       This command can also take one argument: the path of a directory to 
+*       change to. Your cd command should support both absolute and relative 
+*       paths.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    // No arguments == go home
+    if(ourCommand->arguements[0] == NULL)
+    {   
+        chdir(getenv("HOME"));
+        return;
+    }
+
+    // Initilize path (on the stack, nothing to free per call)
+    char buffer[4096];
+    if(getcwd(buffer, sizeof(buffer)) == NULL)
+    {
+        buffer[0] = '\0';
+    }
+    size_t used = strlen(buffer);
+    snprintf(buffer + used, sizeof(buffer) - used, "/%s", ourCommand->arguements[0]);
+    //Relative
+    if (chdir(buffer) == 0)
+    {}
+    //Absolute
+    else if (chdir(ourCommand->arguements[0]) ==0 )
+    {}
+    else
+    {
+        printf("Attempt %s  or  %s\n", ourCommand->arguements[0], buffer);
+        printf("No such file or directory\n");
+        fflush(stdout);
+    }
+}
+
+void statusProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*   The status command prints out either the exit status or the terminating 
+*   signal of the last foreground process ran by your shell.
+*   
+*    If this command is run before any foreground command is run, it'll 
+*    return the exit status 0.
+*    The three built-in shell commands do not count as foreground processes 
+*
+*    status -v also prints the resources used by the last foreground 
+*    command and by the last background job to finish (see printUsage)
+*    A command killed by its timeout shows exit value 124 (timed out)
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS        - Last exit status of a foreground process
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+    {
+        if(*FGS == TIMEOUT_STATUS && foregroundTimedOut == true)
+        {
+            printf("exit value %d (timed out)\n", *FGS);
+        }
+        else
+        {
+            printf("exit value %d\n", *FGS);
+        }
+        if(ourCommand->arguements[0] != NULL && strcmp(ourCommand->arguements[0], "-v") == 0)
+        {
+            if(foregroundRuns > 0)
+            {
+                printUsage(stdout, "foreground", &foregroundUsage);
+            }
+            if(jobUsage.text != NULL)
+            {
+                printUsage(stdout, "background", &jobUsage);
+            }
+        }
+        fflush(stdout);
+    }
+
+void echoProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       echo [-n] [arg1 ...] writes its arguements separated by spaces, 
+*       followed by a newline unless -n is given. No escapes are 
+*       interpreted, like the echo utility.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char **arguement = ourCommand->arguements;
+    bool newline = true;
+    if(arguement[0] != NULL && strcmp(arguement[0], "-n") == 0)
+    {
+        newline = false;
+        arguement ++;
+    }
+    for(int x = 0; arguement[x] != NULL; x++)
+    {
+        if(x > 0)
+        {
+            putchar(' ');
+        }
+        fputs(arguement[x], stdout);
+    }
+    if(newline == true)
+    {
+        putchar('\n');
+    }
+    *FGS = 0;
+}
+
+void trueProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       true does nothing, successfully
+****************************************************************************/
+{
+    *FGS = 0;
+}
+
+void falseProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       false does nothing, unsuccessfully
+****************************************************************************/
+{
+    *FGS = 1;
+}
+
+void pwdProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       pwd prints the working directory of smallsh
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements (unused)
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char buffer[4096];
+    if(getcwd(buffer, sizeof(buffer)) == NULL)
+    {
+        perror("pwd");
+        *FGS = 1;
+        return;
+    }
+    puts(buffer);
+    *FGS = 0;
+}
+
+int testNumber(const char *text, long *value)
+/***************************************************************************
+*   Description -
+*       Reads an integer operand of test
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *text        - Operand
+*       long *value             - Set to its value
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - 0 if it is an integer, 2 otherwise
+****************************************************************************/
+{
+    char *end;
+    errno = 0;
+    *value = strtol(text, &end, 10);
+    while(isspace((unsigned char)*end))
+    {
+        end ++;
+    }
+    if(end == text || *end != '\0' || errno != 0)
+    {
+        printf("test: %s: integer expression expected\n", text);
+        return 2;
+    }
+    return 0;
+}
+
+int testExpression(char **arguement, int count)
+/***************************************************************************
+*   Description -
+*       Evaluates a test expression of up to four arguements the way POSIX
+*       test does: one string, a unary file or string operator, a binary
+*       string or integer comparison, each optionally negated with !
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       char **arguement        - Expression words
+*       int count               - Number of words
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - 0 true, 1 false, 2 error
+****************************************************************************/
+{
+    if(count == 0)
+    {
+        return 1;
+    }
+    if(count == 1)
+    {
+        return arguement[0][0] != '\0' ? 0 : 1;
+    }
+    // Negation, unless ! is the left side of a binary operator
+    if(strcmp(arguement[0], "!") == 0 && count != 3)
+    {
+        int result = testExpression(arguement + 1, count - 1);
+        return result == 2 ? 2 : !result;
+    }
+    if(count == 2)
+    {
+        const char *operator = arguement[0];
+        const char *operand = arguement[1];
+        if(operator[0] != '-' || operator[1] == '\0' || operator[2] != '\0')
+        {
+            printf("test: %s: unary operator expected\n", operator);
+            return 2;
+        }
+        if(operator[1] == 'z')
+        {
+            return operand[0] == '\0' ? 0 : 1;
+        }
+        if(operator[1] == 'n')
+        {
+            return operand[0] != '\0' ? 0 : 1;
+        }
+
+        struct stat info;
+        int found = operator[1] == 'L' || operator[1] == 'h' ? lstat(operand, &info) : stat(operand, &info);
+        switch(operator[1])
+        {
+            case 'e': return found == 0 ? 0 : 1;
+            case 'f': return found == 0 && S_ISREG(info.st_mode) ? 0 : 1;
+            case 'd': return found == 0 && S_ISDIR(info.st_mode) ? 0 : 1;
+            case 'L':
+            case 'h': return found == 0 && S_ISLNK(info.st_mode) ? 0 : 1;
+            case 'p': return found == 0 && S_ISFIFO(info.st_mode) ? 0 : 1;
+            case 'S': return found == 0 && S_ISSOCK(info.st_mode) ? 0 : 1;
+            case 'b': return found == 0 && S_ISBLK(info.st_mode) ? 0 : 1;
+            case 'c': return found == 0 && S_ISCHR(info.st_mode) ? 0 : 1;
+            case 's': return found == 0 && info.st_size > 0 ? 0 : 1;
+            case 'r': return access(operand, R_OK) == 0 ? 0 : 1;
+            case 'w': return access(operand, W_OK) == 0 ? 0 : 1;
+            case 'x': return access(operand, X_OK) == 0 ? 0 : 1;
+        }
+        printf("test: %s: unary operator expected\n", operator);
+        return 2;
+    }
+    if(count == 3)
+    {
+        const char *operator = arguement[1];
+        if(strcmp(operator, "=") == 0)
+        {
+            return strcmp(arguement[0], arguement[2]) == 0 ? 0 : 1;
+        }
+        if(strcmp(operator, "!=") == 0)
+        {
+            return strcmp(arguement[0], arguement[2]) != 0 ? 0 : 1;
+        }
+        static const char *comparisons[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        for(int x = 0; x < 6; x++)
+        {
+            if(strcmp(operator, comparisons[x]) != 0)
+            {
+                continue;
+            }
+            long left;
+            long right;
+            if(testNumber(arguement[0], &left) != 0 || testNumber(arguement[2], &right) != 0)
+            {
+                return 2;
+            }
+            bool result[] = {left == right, left != right, left < right, 
+                             left <= right, left > right, left >= right};
+            return result[x] == true ? 0 : 1;
+        }
+        // ! followed by a two word expression
+        if(strcmp(arguement[0], "!") == 0)
+        {
+            int result = testExpression(arguement + 1, 2);
+            return result == 2 ? 2 : !result;
+        }
+        printf("test: %s: binary operator expected\n", operator);
+        return 2;
+    }
+    printf("test: too many arguments\n");
+    return 2;
+}
+
+void testProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       test expression and [ expression ] set the exit status to 0 when
+*       the expression holds, 1 when it does not and 2 on a bad 
+*       expression (see testExpression)
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    int count = 0;
+    while(ourCommand->arguements[count] != NULL)
+    {
+        count ++;
+    }
+    if(strcmp(ourCommand->commandType, "[") == 0)
+    {
+        if(count == 0 || strcmp(ourCommand->arguements[count - 1], "]") != 0)
+        {
+            printf("[: missing ]\n");
+            *FGS = 2;
+            return;
+        }
+        count --;
+    }
+    *FGS = testExpression(ourCommand->arguements, count);
+}
+
+struct pathEntry
+/**************************************************************************
+*   Description -
+*       Hash table node mapping a command name to the executable found for
+*       it on $PATH, so launches skip the execvp() directory walk
+*   -----------------------------------------------------------------------
+*    char *name                 - Command name as typed
+*    char *path                 - Resolved executable path
+*    int hits                   - Times the entry was used
+*    struct pathEntry *next     - Next node in the bucket chain
+*
+***************************************************************************/
+{
+    char *name;
+    char *path;
+    int hits;
+    struct pathEntry *next;
+};
+
+// Resolved command table and the $PATH value it was built against
+#define PATH_BUCKETS 256
+struct pathEntry *pathTable[PATH_BUCKETS];
+char *pathCached = NULL;
+
+unsigned long hashString(const char *string)
+/***************************************************************************
+*   Description -
+*       FNV-1a hash of a NUL terminated string
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *string      - String to hash
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      unsigned long            - Hash value
+****************************************************************************/
+{
+    unsigned long hash = 14695981039346656037UL;
+    while(*string != '\0')
+    {
+        hash ^= (unsigned char)*string++;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+void clearPathCache(void)
+/***************************************************************************
+*   Description -
+*       Frees every entry of the resolved command table
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    for(int x = 0; x < PATH_BUCKETS; x++)
+    {
+        struct pathEntry *entry = pathTable[x];
+        while(entry != NULL)
+        {
+            struct pathEntry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        pathTable[x] = NULL;
+    }
+}
+
+void forgetPath(const char *name)
+/***************************************************************************
+*   Description -
+*       Drops a single stale entry from the resolved command table
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *name        - Command name to forget
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct pathEntry **link = &pathTable[hashString(name) % PATH_BUCKETS];
+    while(*link != NULL)
+    {
+        if(strcmp((*link)->name, name) == 0)
+        {
+            struct pathEntry *stale = *link;
+            *link = stale->next;
+            free(stale->name);
+            free(stale->path);
+            free(stale);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+const char *resolvePath(const char *name)
+/***************************************************************************
+*   Description -
+*       Finds the executable for a command name. Names containing a '/' are
+*       used as is. Otherwise the resolved command table is checked first,
+*       and only on a miss are the $PATH directories searched, in order.
+*       The whole table is dropped whenever $PATH no longer matches the
+*       value it was built against.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *name        - Command name
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      const char *             - Executable path, NULL if none was found
+****************************************************************************/
+{
+    if(strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+
+    // PATH changed since the table was built, start over
+    char *path = getenv("PATH");
+    if(path == NULL)
+    {
+        path = "/bin:/usr/bin";
+    }
+    if(pathCached == NULL || strcmp(pathCached, path) != 0)
+    {
+        clearPathCache();
+        free(pathCached);
+        pathCached = strdup(path);
+    }
+
+    unsigned long bucket = hashString(name) % PATH_BUCKETS;
+    for(struct pathEntry *entry = pathTable[bucket]; entry != NULL; entry = entry->next)
+    {
+        if(strcmp(entry->name, name) == 0)
+        {
+            entry->hits ++;
+            return entry->path;
+        }
+    }
+
+    // Walk each PATH directory, an empty element means the current directory
+    size_t nameLength = strlen(name);
+    const char *dir = path;
+    while(true)
+    {
+        const char *end = strchrnul(dir, ':');
+        size_t dirLength = end - dir;
+        char candidate[dirLength + nameLength + 3];
+        if(dirLength == 0)
+        {
+            memcpy(candidate, "./", 2);
+            dirLength = 2;
+        }
+        else
+        {
+            memcpy(candidate, dir, dirLength);
+            candidate[dirLength++] = '/';
+        }
+        memcpy(candidate + dirLength, name, nameLength + 1);
+
+        struct stat info;
+        if(access(candidate, X_OK) == 0 && stat(candidate, &info) == 0 && S_ISDIR(info.st_mode) == 0)
+        {
+            struct pathEntry *entry = malloc(sizeof(struct pathEntry));
+            entry->name = strdup(name);
+            entry->path = strdup(candidate);
+            entry->hits = 1;
+            entry->next = pathTable[bucket];
+            pathTable[bucket] = entry;
+            return entry->path;
+        }
+
+        if(*end == '\0')
+        {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+void hashProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The hash command manages the resolved command table.
+*
+*       By itself it lists every remembered command with its hit count.
+*       'hash -r' forgets everything, 'hash name ...' resolves and
+*       remembers the given commands.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(ourCommand->arguements[0] == NULL)
+    {
+        printf("hits\tcommand\n");
+        for(int x = 0; x < PATH_BUCKETS; x++)
+        {
+            for(struct pathEntry *entry = pathTable[x]; entry != NULL; entry = entry->next)
+            {
+                printf("%4d\t%s\n", entry->hits, entry->path);
+            }
+        }
+    }
+    else if(strcmp(ourCommand->arguements[0], "-r") == 0)
+    {
+        clearPathCache();
+    }
+    else
+    {
+        for(int x = 0; ourCommand->arguements[x] != NULL; x++)
+        {
+            if(resolvePath(ourCommand->arguements[x]) == NULL)
+            {
+                printf("hash: %s: not found\n", ourCommand->arguements[x]);
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+void cacheProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The cache command manages the parsed line cache (see cachedParse).
+*
+*       By itself it prints how many lines are cached and the hit, miss 
+*       and eviction counts. 'cache -r' empties the cache and zeroes the
+*       counts, 'cache -s N' empties it and keeps at most N lines from 
+*       now on (0 turns caching off).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char **arguement = ourCommand->arguements;
+    if(arguement[0] == NULL)
+    {
+        printf("lines %d/%d hits %lu misses %lu evictions %lu\n", lineCacheCount, 
+               lineCacheCapacity, lineHits, lineMisses, lineEvictions);
+    }
+    else if(strcmp(arguement[0], "-r") == 0)
+    {
+        clearLineCache();
+        lineHits = 0;
+        lineMisses = 0;
+        lineEvictions = 0;
+    }
+    else if(strcmp(arguement[0], "-s") == 0 && arguement[1] != NULL && atoi(arguement[1]) >= 0)
+    {
+        clearLineCache();
+        lineCacheCapacity = atoi(arguement[1]);
+    }
+    else
+    {
+        printf("cache: usage: cache [-r] [-s lines]\n");
+    }
+    fflush(stdout);
+}
+
+struct dirListing
+/**************************************************************************
+*   Description -
+*       Cached listing of one directory, re-read only when the directory's
+*       mtime changes. Used by completion so a slow (network) directory is
+*       not read again on every keystroke, and by globbing.
+*   -----------------------------------------------------------------------
+*    char *path             - Directory as given
+*    struct timespec mtime  - Directory mtime when it was read
+*    struct timespec readTime - Clock when it was read
+*    unsigned long readAt   - Value of listingReads when it was read
+*    unsigned long usedAt   - Value of listingUses when last handed out
+*    char **names           - Entry names, . and .. left out
+*    unsigned char *types   - d_type of each entry (DT_UNKNOWN possible)
+*    int count              - Number of entries
+*    char *storage          - Holds every name
+*    struct dirListing *next - Next listing in the same bucket
+*
+***************************************************************************/
+{
+    char *path;
+    struct timespec mtime;
+    struct timespec readTime;
+    unsigned long readAt;
+    unsigned long usedAt;
+    char **names;
+    unsigned char *types;
+    int count;
+    char *storage;
+    struct dirListing *next;
+};
+
+#define DIR_BUCKETS 64
+#define DIR_LISTINGS_MAX 256        // Listings kept, least recently used go
+struct dirListing *dirTable[DIR_BUCKETS];
+unsigned long listingReads = 0;     // Directories read so far
+unsigned long listingUses = 0;      // Listings handed out so far
+int listingCount = 0;
+
+void freeListing(struct dirListing *listing)
+/***************************************************************************
+*   Description -
+*       Frees a listing that is out of dirTable
+****************************************************************************/
+{
+    free(listing->path);
+    free(listing->names);
+    free(listing->types);
+    free(listing->storage);
+    free(listing);
+}
+
+void evictListing(void)
+/***************************************************************************
+*   Description -
+*       Drops the least recently used listing, keeping the cache at 
+*       DIR_LISTINGS_MAX however many directories are walked
+****************************************************************************/
+{
+    struct dirListing **oldest = NULL;
+    for(int bucket = 0; bucket < DIR_BUCKETS; bucket++)
+    {
+        for(struct dirListing **link = &dirTable[bucket]; *link != NULL; link = &(*link)->next)
+        {
+            if(oldest == NULL || (*link)->usedAt < (*oldest)->usedAt)
+            {
+                oldest = link;
+            }
+        }
+    }
+    if(oldest != NULL)
+    {
+        struct dirListing *listing = *oldest;
+        *oldest = listing->next;
+        freeListing(listing);
+        listingCount --;
+    }
+}
+
+struct dirListing *listDirectory(const char *path)
+/***************************************************************************
+*   Description -
+*       Returns the listing of a directory, from the cache when its mtime
+*       has not changed since it was read (one stat()), otherwise read
+*       again with readdir(). Timestamps are coarse, so a listing read 
+*       within a second of the mtime could miss an entry added in the 
+*       same tick: it is not trusted and is read again next time. The
+*       listing stays valid until the next call.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *path        - Directory to list
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct dirListing *      - Listing, NULL if it is not a directory
+****************************************************************************/
+{
+    struct stat info;
+    if(stat(path, &info) == -1 || S_ISDIR(info.st_mode) == 0)
+    {
+        return NULL;
+    }
+    unsigned long bucket = hashString(path) % DIR_BUCKETS;
+    struct dirListing *listing = dirTable[bucket];
+    while(listing != NULL && strcmp(listing->path, path) != 0)
+    {
+        listing = listing->next;
+    }
+    if(listing != NULL && listing->mtime.tv_sec == info.st_mtim.tv_sec && 
+       listing->mtime.tv_nsec == info.st_mtim.tv_nsec &&
+       listing->readTime.tv_sec > listing->mtime.tv_sec + 1)
+    {
+        listing->usedAt = ++listingUses;
+        return listing;
+    }
+
+    DIR *dir = opendir(path);
+    if(dir == NULL)
+    {
+        return NULL;
+    }
+    if(listing == NULL)
+    {
+        if(listingCount == DIR_LISTINGS_MAX)
+        {
+            evictListing();
+        }
+        listingCount ++;
+        listing = calloc(1, sizeof(struct dirListing));
+        listing->path = strdup(path);
+        listing->next = dirTable[bucket];
+        dirTable[bucket] = listing;
+    }
+    free(listing->names);
+    free(listing->types);
+    free(listing->storage);
+
+    // Names are packed into storage, pointers are set once it stops moving
+    size_t used = 0;
+    size_t capacity = 4096;
+    int slots = 64;
+    char *storage = malloc(capacity);
+    size_t *offsets = malloc(slots * sizeof(size_t));
+    unsigned char *types = malloc(slots);
+    int count = 0;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        size_t length = strlen(entry->d_name) + 1;
+        while(used + length > capacity)
+        {
+            capacity *= 2;
+            storage = realloc(storage, capacity);
+        }
+        if(count == slots)
+        {
+            slots *= 2;
+            offsets = realloc(offsets, slots * sizeof(size_t));
+            types = realloc(types, slots);
+        }
+        memcpy(storage + used, entry->d_name, length);
+        offsets[count] = used;
+        types[count] = entry->d_type;
+        count ++;
+        used += length;
+    }
+    closedir(dir);
+
+    listing->names = malloc((count + 1) * sizeof(char *));
+    for(int x = 0; x < count; x++)
+    {
+        listing->names[x] = storage + offsets[x];
+    }
+    listing->names[count] = NULL;
+    free(offsets);
+    listing->types = types;
+    listing->storage = storage;
+    listing->count = count;
+    listing->mtime = info.st_mtim;
+    clock_gettime(CLOCK_REALTIME, &listing->readTime);
+    listing->readAt = ++listingReads;
+    listing->usedAt = ++listingUses;
+    return listing;
+}
+
+void addField(char ***fields, int *count, const char *text, size_t length, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Appends a copy of text to a growing (malloc'd) word list
+****************************************************************************/
+{
+    if((*count & (*count + 1)) == 0)
+    {
+        *fields = realloc(*fields, (*count + 1) * 2 * sizeof(char *));
+    }
+    char *copy = arenaAlloc(lineArena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    (*fields)[(*count)++] = copy;
+}
+
+int compareNames(const void *left, const void *right)
+/***************************************************************************
+*   Description -
+*       qsort() order for candidate names
+****************************************************************************/
+{
+    return strcmp(*(char * const *)left, *(char * const *)right);
+}
+
+const char *classEnd(const char *pattern)
+/***************************************************************************
+*   Description -
+*       Finds the end of a [...] class. A ] right after [ or [! is part 
+*       of the class, and a class never spans a /.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *pattern     - Points at the [
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      const char *             - Just past the closing ], NULL when there
+*                                 is none and [ is an ordinary character
+****************************************************************************/
+{
+    const char *scan = pattern + 1;
+    if(*scan == '!' || *scan == '^')
+    {
+        scan ++;
+    }
+    if(*scan == ']')
+    {
+        scan ++;
+    }
+    while(*scan != '\0' && *scan != ']' && *scan != '/')
+    {
+        scan ++;
+    }
+    return *scan == ']' ? scan + 1 : NULL;
+}
+
+bool classMatch(const char *pattern, const char *end, unsigned char byte)
+/***************************************************************************
+*   Description -
+*       Checks a byte against a class: [abc], ranges like [a-z], and 
+*       [!...] or [^...] for everything else
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *pattern     - Points at the [
+*       const char *end         - From classEnd()
+*       unsigned char byte      - Byte to check
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - true if the class matches byte
+****************************************************************************/
+{
+    const char *scan = pattern + 1;
+    const char *last = end - 1;
+    bool negate = *scan == '!' || *scan == '^';
+    if(negate == true)
+    {
+        scan ++;
+    }
+    bool found = false;
+    while(scan < last && found == false)
+    {
+        if(scan + 2 < last && scan[1] == '-')
+        {
+            found = (unsigned char)scan[0] <= byte && byte <= (unsigned char)scan[2];
+            scan += 3;
+        }
+        else
+        {
+            found = (unsigned char)*scan == byte;
+            scan ++;
+        }
+    }
+    return found != negate;
+}
+
+bool hasGlob(const char *word)
+/***************************************************************************
+*   Description -
+*       Checks whether a word is a pattern: it has a * or ?, or a [ that
+*       starts a complete class
+****************************************************************************/
+{
+    for(const char *scan = strpbrk(word, "*?["); scan != NULL; scan = strpbrk(scan + 1, "*?["))
+    {
+        if(*scan != '[' || classEnd(scan) != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool globMatch(const char *pattern, const char *name)
+/***************************************************************************
+*   Description -
+*       Matches a name against one path component of a pattern: * is 
+*       any run of bytes, ? any byte, [...] a class. A leading . has to
+*       be matched by a literal .
+*
+*       One pass over the name. A mismatch only resumes from the last * 
+*       with the name one byte further along, so the cost is at most 
+*       name x pattern however many *s there are, never the exponential 
+*       backtracking of a recursive matcher.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *pattern     - Component, without /
+*       const char *name        - Directory entry
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - true if name matches
+****************************************************************************/
+{
+    if(name[0] == '.' && pattern[0] != '.')
+    {
+        return false;
+    }
+    const char *resumePattern = NULL;
+    const char *resumeName = NULL;
+    while(*name != '\0')
+    {
+        if(*pattern == '*')
+        {
+            while(*pattern == '*')
+            {
+                pattern ++;
+            }
+            if(*pattern == '\0')
+            {
+                return true;
+            }
+            resumePattern = pattern;
+            resumeName = name;
+            continue;
+        }
+        const char *close = *pattern == '[' ? classEnd(pattern) : NULL;
+        if(close != NULL && classMatch(pattern, close, *name) == true)
+        {
+            pattern = close;
+            name ++;
+        }
+        else if(close == NULL && *pattern != '\0' && (*pattern == '?' || *pattern == *name))
+        {
+            pattern ++;
+            name ++;
+        }
+        else if(resumePattern != NULL)
+        {
+            pattern = resumePattern;
+            name = ++resumeName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while(*pattern == '*')
+    {
+        pattern ++;
+    }
+    return *pattern == '\0';
+}
+
+bool isDirectory(const char *path, unsigned char type)
+/***************************************************************************
+*   Description -
+*       Checks a directory entry is a directory, following symbolic links
+*       like open() would. type is the entry's d_type.
+****************************************************************************/
+{
+    if(type != DT_LNK && type != DT_UNKNOWN)
+    {
+        return type == DT_DIR;
+    }
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+void globPath(const char *pattern, char *path, size_t used, char ***found, int *count, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Expands the rest of a pattern below path, one component at a 
+*       time. Components without a pattern are taken as they are, the 
+*       others are matched against the directory's cached listing (see
+*       listDirectory), and every match that is a directory is walked 
+*       into when more components follow. A trailing / only matches 
+*       directories and is kept.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *pattern     - What is left of the pattern
+*       char *path              - PATH_MAX buffer, matched so far
+*       size_t used             - Length of path ("" for the current 
+*                                 directory, else ends in /)
+*       char ***found           - Receives the paths that exist
+*       int *count              - Paths in found
+*       struct arena *lineArena - Per line arena
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    const char *slash = strchrnul(pattern, '/');
+    size_t length = slash - pattern;
+    const char *rest = slash;
+    while(*rest == '/')
+    {
+        rest ++;
+    }
+    bool last = *rest == '\0';
+    bool directoryOnly = *slash == '/';
+    if(used + length + 2 > PATH_MAX)
+    {
+        return;
+    }
+    char component[length + 1];
+    memcpy(component, pattern, length);
+    component[length] = '\0';
+
+    // Nothing to match, the name only has to exist
+    if(hasGlob(component) == false)
+    {
+        memcpy(path + used, component, length);
+        path[used + length] = '\0';
+        struct stat info;
+        if(last == true && lstat(path, &info) == 0 && (directoryOnly == false || isDirectory(path, DT_UNKNOWN) == true))
+        {
+            strcpy(path + used + length, directoryOnly == true ? "/" : "");
+            addField(found, count, path, strlen(path), lineArena);
+        }
+        else if(last == false)
+        {
+            strcpy(path + used + length, "/");
+            globPath(rest, path, used + length + 1, found, count, lineArena);
+        }
+        return;
+    }
+
+    // Matches are copied out first, the listing may be replaced while 
+    // walking into them
+    path[used] = '\0';
+    struct dirListing *listing = listDirectory(used == 0 ? "." : path);
+    char **matches = NULL;
+    int matched = 0;
+    for(int x = 0; listing != NULL && x < listing->count; x++)
+    {
+        if(globMatch(component, listing->names[x]) == true)
+        {
+            addField(&matches, &matched, listing->names[x], strlen(listing->names[x]), lineArena);
+            if(directoryOnly == true)
+            {
+                snprintf(path + used, PATH_MAX - used, "%s", listing->names[x]);
+                if(isDirectory(path, listing->types[x]) == false)
+                {
+                    matched --;
+                }
+                path[used] = '\0';
+            }
+        }
+    }
+    for(int x = 0; x < matched; x++)
+    {
+        size_t nameLength = strlen(matches[x]);
+        if(used + nameLength + 2 > PATH_MAX)
+        {
+            continue;
+        }
+        memcpy(path + used, matches[x], nameLength);
+        strcpy(path + used + nameLength, directoryOnly == true ? "/" : "");
+        if(last == true)
+        {
+            addField(found, count, path, strlen(path), lineArena);
+        }
+        else
+        {
+            globPath(rest, path, used + nameLength + 1, found, count, lineArena);
+        }
+    }
+    free(matches);
+}
+
+int globWord(const char *word, char ***found, int *count, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Adds the paths a pattern matches to found, sorted
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *word        - Pattern (see globMatch)
+*       char ***found           - Word list the paths are added to
+*       int *count              - Words in found
+*       struct arena *lineArena - Per line arena
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Number of paths added, 0 for no match
+****************************************************************************/
+{
+    char path[PATH_MAX];
+    size_t used = 0;
+    if(word[0] == '/')
+    {
+        path[used++] = '/';
+        while(*word == '/')
+        {
+            word ++;
+        }
+    }
+    int before = *count;
+    globPath(word, path, used, found, count, lineArena);
+    qsort(*found + before, *count - before, sizeof(char *), compareNames);
+    return *count - before;
+}
+
+struct command *globCommand(struct command *ourCommand, struct arena *lineArena)
+/***************************************************************************
+*   Description -
+*       Pathname expansion. An arguement with *, ? or [...] is replaced 
+*       by the paths it matches in sorted order, or kept as typed if it
+*       matches none. A < or > file has to match exactly one path.
+*
+*       The parsed line may be shared with the line cache, so the result 
+*       is a new command in lineArena and ourCommand is left as is. A line
+*       without patterns is returned as it is.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Parsed line with glob set
+*       struct arena *lineArena         - Per line arena
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct command *                 - Line to run, NULL (reported) for
+*                                         an ambiguous redirection
+****************************************************************************/
+{
+    bool patterns = false;
+    for(struct command *stage = ourCommand; stage != NULL && patterns == false; stage = stage->next)
+    {
+        for(char **word = stage->argv; word != NULL && *word != NULL && patterns == false; word++)
+        {
+            patterns = hasGlob(*word);
+        }
+        patterns = patterns || (stage->inputFile != NULL && hasGlob(stage->inputFile) == true) ||
+                   (stage->outputFile != NULL && hasGlob(stage->outputFile) == true);
+    }
+    if(patterns == false)
+    {
+        return ourCommand;
+    }
+
+    struct command *first = NULL;
+    struct command **link = &first;
+    char **fields = NULL;
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next)
+    {
+        struct command *copy = arenaAlloc(lineArena, sizeof(struct command));
+        *copy = *stage;
+        copy->glob = false;
+        copy->next = NULL;
+        *link = copy;
+        link = &copy->next;
+
+        int count = 0;
+        for(char **word = stage->argv; word != NULL && *word != NULL; word++)
+        {
+            if(hasGlob(*word) == false || globWord(*word, &fields, &count, lineArena) == 0)
+            {
+                addField(&fields, &count, *word, strlen(*word), lineArena);
+            }
+        }
+        char **file[2] = {&copy->inputFile, &copy->outputFile};
+        for(int x = 0; x < 2; x++)
+        {
+            if(*file[x] == NULL || hasGlob(*file[x]) == false)
+            {
+                continue;
+            }
+            char **paths = NULL;
+            int matched = 0;
+            globWord(*file[x], &paths, &matched, lineArena);
+            if(matched > 1)
+            {
+                printf("%s: ambiguous redirect\n", *file[x]);
+                fflush(stdout);
+                free(paths);
+                free(fields);
+                return NULL;
+            }
+            if(matched == 1)
+            {
+                *file[x] = paths[0];
+            }
+            free(paths);
+        }
+
+        copy->argv = arenaAlloc(lineArena, (count + 1) * sizeof(char *));
+        if(count > 0)
+        {
+            memcpy(copy->argv, fields, count * sizeof(char *));
+        }
+        copy->argv[count] = NULL;
+        copy->arguements = count > 0 ? copy->argv + 1 : copy->argv;
+        copy->commandType = count > 0 ? copy->argv[0] : "Blank";
+    }
+    free(fields);
+    return first;
+}
+
+struct launchPolicy
+/**************************************************************************
+*   Description -
+*       CPU and scheduling settings applied to launched commands, in the
+*       child just before exec. Set shell wide with policy, or for one 
+*       line with the cpus prefix.
+*   -----------------------------------------------------------------------
+*    bool pinned            - Restrict the child to cpus
+*    cpu_set_t cpus         - CPUs the child may run on
+*    bool setNice           - Apply nice
+*    int nice               - Nice level
+*    bool batch             - Run under SCHED_BATCH
+*    int ioClass            - I/O priority class (1 rt, 2 be, 3 idle), 
+*                             0 leaves it alone
+*    int ioLevel            - I/O priority level within the class, 0 - 7
+*
+***************************************************************************/
+{
+    bool pinned;
+    cpu_set_t cpus;
+    bool setNice;
+    int nice;
+    bool batch;
+    int ioClass;
+    int ioLevel;
+};
+
+// Shell wide policy, and the one in force for the line being run
+struct launchPolicy defaultPolicy;
+struct launchPolicy linePolicy;
+struct launchPolicy *currentPolicy = &defaultPolicy;
+
+bool policyActive(const struct launchPolicy *policy)
+/***************************************************************************
+*   Description -
+*       Checks whether a policy changes anything for a child
+****************************************************************************/
+{
+    return policy->pinned || policy->setNice || policy->batch || policy->ioClass != 0;
+}
+
+bool parseCpuList(const char *text, cpu_set_t *cpus)
+/***************************************************************************
+*   Description -
+*       Reads a CPU list like taskset -c takes: 0-3,6,8-11
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *text        - CPU list
+*       cpu_set_t *cpus         - Set to the CPUs listed
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - false if the list is malformed
+****************************************************************************/
+{
+    CPU_ZERO(cpus);
+    while(*text != '\0')
+    {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+        if(end == text || first < 0)
+        {
+            return false;
+        }
+        if(*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if(end == text || last < first)
+            {
+                return false;
+            }
+        }
+        if(last >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        for(long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+        text = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+int parsePolicy(char **word, struct launchPolicy *policy, const char *name)
+/***************************************************************************
+*   Description -
+*       Reads policy options into policy, stopping at the first word that
+*       is not one:
+*           -c LIST         - CPUs (see parseCpuList)
+*           -n N            - nice level
+*           -b              - SCHED_BATCH
+*           -i CLASS[:N]    - I/O priority, CLASS is rt, be or idle
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       char **word             - Words to read, NULL terminated
+*       struct launchPolicy *policy - Updated with each option
+*       const char *name        - Built in name for messages
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Words used, -1 on a bad option
+****************************************************************************/
+{
+    int used = 0;
+    while(word[used] != NULL && word[used][0] == '-')
+    {
+        const char *option = word[used];
+        const char *value = word[used + 1];
+        if(strcmp(option, "-b") == 0)
+        {
+            policy->batch = true;
+            used ++;
+            continue;
+        }
+        if(value == NULL || option[2] != '\0')
+        {
+            printf("%s: bad option %s\n", name, option);
+            return -1;
+        }
+        if(option[1] == 'c' && parseCpuList(value, &policy->cpus) == true)
+        {
+            policy->pinned = true;
+        }
+        else if(option[1] == 'n' && (isdigit((unsigned char)value[0]) || value[0] == '-'))
+        {
+            policy->setNice = true;
+            policy->nice = atoi(value);
+        }
+        else if(option[1] == 'i' && (strncmp(value, "rt", 2) == 0 || strncmp(value, "be", 2) == 0 || 
+                                     strncmp(value, "idle", 4) == 0))
+        {
+            policy->ioClass = value[0] == 'r' ? 1 : value[0] == 'b' ? 2 : 3;
+            const char *level = strchr(value, ':');
+            policy->ioLevel = level != NULL ? atoi(level + 1) & 7 : 4;
+        }
+        else
+        {
+            printf("%s: bad value %s for %s\n", name, value, option);
+            return -1;
+        }
+        used += 2;
+    }
+    return used;
+}
+
+void applyPolicy(const struct launchPolicy *policy)
+/***************************************************************************
+*   Description -
+*       Applies a policy to the calling process, the child between fork()
+*       and exec. A setting that is refused is reported, the command 
+*       still runs.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const struct launchPolicy *policy   - Policy to apply
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(policy->pinned == true && sched_setaffinity(0, sizeof(cpu_set_t), &policy->cpus) == -1)
+    {
+        perror("sched_setaffinity()");
+    }
+    if(policy->batch == true)
+    {
+        struct sched_param parameter = {0};
+        if(sched_setscheduler(0, SCHED_BATCH, &parameter) == -1)
+        {
+            perror("sched_setscheduler()");
+        }
+    }
+    if(policy->setNice == true && setpriority(PRIO_PROCESS, 0, policy->nice) == -1)
+    {
+        perror("setpriority()");
+    }
+    // ioprio_set(IOPRIO_WHO_PROCESS, self, class << IOPRIO_CLASS_SHIFT | level)
+    if(policy->ioClass != 0 && syscall(SYS_ioprio_set, 1, 0, policy->ioClass << 13 | policy->ioLevel) == -1)
+    {
+        perror("ioprio_set()");
+    }
+}
+
+void policyPrefix(struct command *ourCommand)
+/***************************************************************************
+*   Description -
+*       Handles the cpus prefix (cpus LIST [options] command [arg1 ...]):
+*       strips it from a copy of the first stage and makes the shell wide
+*       policy plus LIST and the options (see parsePolicy) the policy for
+*       this line. A bad prefix turns the line into a blank one.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Copy of the line's first stage
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    linePolicy = defaultPolicy;
+    char **word = ourCommand->arguements;
+    int used = -1;
+    if(word[0] != NULL && (strcmp(word[0], "-") == 0 || parseCpuList(word[0], &linePolicy.cpus) == true))
+    {
+        linePolicy.pinned = linePolicy.pinned || strcmp(word[0], "-") != 0;
+        used = parsePolicy(word + 1, &linePolicy, "cpus");
+    }
+    if(used == -1 || word[used + 1] == NULL)
+    {
+        printf("cpus: usage: cpus LIST|- [-n N] [-b] [-i CLASS[:N]] command ...\n");
+        fflush(stdout);
+        ourCommand->commandType = "Blank";
+        return;
+    }
+    ourCommand->argv = word + used + 1;
+    ourCommand->arguements = ourCommand->argv + 1;
+    ourCommand->commandType = ourCommand->argv[0];
+    currentPolicy = &linePolicy;
+}
+
+void policyProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The policy command sets the shell wide launch policy (see 
+*       parsePolicy for the options), applied to every command launched
+*       from then on. By itself it prints the policy, 'policy -r' 
+*       removes it.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char **word = ourCommand->arguements;
+    if(word[0] != NULL && strcmp(word[0], "-r") == 0)
+    {
+        memset(&defaultPolicy, 0, sizeof(defaultPolicy));
+    }
+    else if(word[0] != NULL)
+    {
+        struct launchPolicy policy = defaultPolicy;
+        int used = parsePolicy(word, &policy, "policy");
+        if(used != -1 && word[used] == NULL)
+        {
+            defaultPolicy = policy;
+        }
+        else if(used != -1)
+        {
+            printf("policy: bad option %s\n", word[used]);
+        }
+    }
+    else if(policyActive(&defaultPolicy) == false)
+    {
+        printf("policy: none\n");
+    }
+    else
+    {
+        printf("policy:");
+        if(defaultPolicy.pinned == true)
+        {
+            // Print the CPUs back as ranges
+            printf(" cpus ");
+            const char *separator = "";
+            for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if(CPU_ISSET(cpu, &defaultPolicy.cpus) == 0)
+                {
+                    continue;
+                }
+                int last = cpu;
+                while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &defaultPolicy.cpus))
+                {
+                    last ++;
+                }
+                printf(last > cpu ? "%s%d-%d" : "%s%d", separator, cpu, last);
+                separator = ",";
+                cpu = last;
+            }
+        }
+        if(defaultPolicy.setNice == true)
+        {
+            printf(" nice %d", defaultPolicy.nice);
+        }
+        if(defaultPolicy.batch == true)
+        {
+            printf(" batch");
+        }
+        if(defaultPolicy.ioClass != 0)
+        {
+            const char *classes[] = {"", "rt", "be", "idle"};
+            printf(" io %s:%d", classes[defaultPolicy.ioClass], defaultPolicy.ioLevel);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+struct deadline
+/**************************************************************************
+*   Description -
+*       Time limit of a foreground command being waited on, or of one 
+*       line of parallel or dag. When it expires the processes get 
+*       SIGTERM, and SIGKILL if they are still there after the grace 
+*       period. A timed command runs in a process group of its own, so 
+*       whatever it started is signalled with it. Reaped pids are set to
+*       -1 by the waiter so a recycled pid is never signalled.
+*   -----------------------------------------------------------------------
+*    struct eventSource timer - timerfd, data is the deadline
+*    pid_t *pids            - Processes of the command
+*    int count              - Number of pids
+*    pid_t group            - Process group of the command, -1 if none
+*    int stage              - 0 armed, 1 SIGTERM sent, 2 SIGKILL sent,
+*                             -1 when the command has no limit
+*
+***************************************************************************/
+{
+    struct eventSource timer;
+    pid_t *pids;
+    int count;
+    pid_t group;
+    int stage;
+};
+
+void deadlineExpired(struct eventSource *timer, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Timer handler of a deadline, escalates one stage
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *timer   - The deadline's timer
+*       uint32_t events             - Unused
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    uint64_t expirations;
+    if(read(timer->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+        return;
+    }
+    struct deadline *limit = timer->data;
+    int signal = limit->stage == 0 ? SIGTERM : SIGKILL;
+    // The group outlives its leader while anything the command started runs
+    if(limit->group > 0)
+    {
+        kill(-limit->group, signal);
+    }
+    for(int x = 0; x < limit->count; x++)
+    {
+        if(limit->pids[x] > 0)
+        {
+            kill(limit->pids[x], signal);
+        }
+    }
+    limit->stage ++;
+    if(limit->stage == 1)
+    {
+        startTimer(timer, lineGrace);
+    }
+}
+
+void startDeadline(struct deadline *limit, pid_t *pids, int count, pid_t group)
+/***************************************************************************
+*   Description -
+*       Arms the deadline for a foreground command when this line has a
+*       limit. Without one it costs nothing. A timed command's group 
+*       (see timedGroup) gets the terminal until stopDeadline(), like fg
+*       hands it to a job.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct deadline *limit      - Deadline to arm
+*       pid_t *pids                 - Processes of the command, -1 skipped
+*       int count                   - Number of pids
+*       pid_t group                 - Process group of the command, -1 if
+*                                     it runs in ours
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    limit->timer.fd = -1;
+    limit->timer.ready = deadlineExpired;
+    limit->timer.data = limit;
+    limit->pids = pids;
+    limit->count = count;
+    limit->group = group;
+    limit->stage = -1;
+    if(lineTimeout <= 0)
+    {
+        return;
+    }
+    if(group > 0 && lineEditing == true)
+    {
+        tcsetpgrp(STDIN_FILENO, group);
+    }
+    if(startTimer(&limit->timer, lineTimeout) == true)
+    {
+        limit->stage = 0;
+    }
+}
+
+bool stopDeadline(struct deadline *limit)
+/***************************************************************************
+*   Description -
+*       Disarms the deadline once the command has been reaped
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - true if the command ran out of time
+****************************************************************************/
+{
+    foregroundTimedOut = limit->stage > 0;
+    if(limit->stage != -1)
+    {
+        stopTimer(&limit->timer);
+    }
+    if(lineTimeout > 0 && limit->group > 0 && lineEditing == true)
+    {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    return foregroundTimedOut;
+}
+
+pid_t timedGroup(bool backGround)
+/***************************************************************************
+*   Description -
+*       Process group to launch a command in (see launchProcess). Jobs 
+*       lead a group of their own, and so does a foreground command with
+*       a time limit, so the limit reaches everything it starts. Other 
+*       foreground commands stay in the shell's group.
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      pid_t                        - 0 to lead a new group, -1 for ours
+****************************************************************************/
+{
+    return backGround == true || lineTimeout > 0 ? 0 : -1;
+}
+
+pid_t listGroup(void)
+/***************************************************************************
+*   Description -
+*       Process group for a line of parallel or dag. With a time limit it
+*       leads a group of its own like any timed command, except on a 
+*       terminal: several lines run at once and ^C only reaches the 
+*       shell's group, so there they stay in it.
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      pid_t                        - 0 to lead a new group, -1 for ours
+****************************************************************************/
+{
+    return lineTimeout > 0 && lineEditing == false ? 0 : -1;
+}
+
+bool parseDuration(const char *text, double *seconds)
+/***************************************************************************
+*   Description -
+*       Reads a duration: a number with an optional s, m, h or d suffix
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false if text is not a duration
+****************************************************************************/
+{
+    char *end;
+    errno = 0;
+    double value = strtod(text, &end);
+    if(end == text || errno != 0 || value < 0 || value != value)
+    {
+        return false;
+    }
+    switch(*end)
+    {
+        case 'd':
+            value *= 24;
+            // fall through
+        case 'h':
+            value *= 60;
+            // fall through
+        case 'm':
+            value *= 60;
+            // fall through
+        case 's':
+            end ++;
+            break;
+    }
+    if(*end != '\0')
+    {
+        return false;
+    }
+    *seconds = value;
+    return true;
+}
+
+bool timeoutPrefix(struct command *ourCommand)
+/***************************************************************************
+*   Description -
+*       Handles the timeout prefix (timeout [-k GRACE] DURATION command 
+*       [arg1 ...]): strips it from a copy of the first stage and limits
+*       this line to DURATION, GRACE (else the shell's) being the wait
+*       between SIGTERM and SIGKILL. Background commands are not limited.
+*       A bad prefix turns the line into a blank one.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Copy of the line's first stage
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                             - false for the built in forms
+*                                         (timeout, timeout -d ...)
+****************************************************************************/
+{
+    char **word = ourCommand->arguements;
+    if(word[0] == NULL || strcmp(word[0], "-d") == 0)
+    {
+        return false;
+    }
+    if(strcmp(word[0], "-k") == 0)
+    {
+        if(word[1] == NULL || parseDuration(word[1], &lineGrace) == false)
+        {
+            word = NULL;
+        }
+        else
+        {
+            word += 2;
+        }
+    }
+    if(word == NULL || word[0] == NULL || parseDuration(word[0], &lineTimeout) == false || word[1] == NULL)
+    {
+        printf("timeout: usage: timeout [-k GRACE] DURATION command ...\n");
+        fflush(stdout);
+        ourCommand->commandType = "Blank";
+        return true;
+    }
+    ourCommand->argv = word + 1;
+    ourCommand->arguements = ourCommand->argv + 1;
+    ourCommand->commandType = ourCommand->argv[0];
+    return true;
+}
+
+void timeoutProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The timeout command sets the shell wide limit every foreground 
+*       command runs under: 'timeout -d DURATION [-k GRACE]', where 0 
+*       removes it. By itself it prints the limit. With a command it is
+*       the timeout prefix instead (see timeoutPrefix).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status, 1 on a 
+*                                         usage error
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    char **word = ourCommand->arguements;
+    if(word[0] == NULL)
+    {
+        if(defaultTimeout > 0)
+        {
+            printf("timeout: %gs, grace %gs\n", defaultTimeout, defaultGrace);
+        }
+        else
+        {
+            printf("timeout: none, grace %gs\n", defaultGrace);
+        }
+        fflush(stdout);
+        return;
+    }
+    double limit;
+    double grace = defaultGrace;
+    if(word[1] == NULL || parseDuration(word[1], &limit) == false ||
+       (word[2] != NULL && (strcmp(word[2], "-k") != 0 || word[3] == NULL ||
+                            parseDuration(word[3], &grace) == false || word[4] != NULL)))
+    {
+        printf("timeout: usage: timeout -d DURATION [-k GRACE]\n");
+        fflush(stdout);
+        *FGS = 1;
+        return;
+    }
+    defaultTimeout = limit;
+    defaultGrace = grace;
+}
+
+void forkProcess(const char *path, char **argv, int sourceFD, int targetFD, int errorFD, bool backGround, pid_t group, pid_t *spawnPid, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Fallback launch path used when posix_spawn() cannot create the child
+*       (EAGAIN/ENOMEM/ENOSYS), and the launch path whenever a launch policy
+*       is in force. Forks a full copy of the shell, then sets up signals,
+*       redirections and the policy in the child before calling execvp().
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *path                - Resolved executable
+*       char **argv                     - NULL terminated arguement vector
+*       int sourceFD                    - Opened input file or -1
+*       int targetFD                    - Opened output file or -1
+*       int errorFD                     - stderr for the child or -1
+*       bool backGround                 - Child runs in the background
+*       pid_t group                     - Process group (see launchProcess)
+*       pid_t *spawnPid                 - Set to the child pid, -1 on failure
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+{
+    // Due to server crashes, program reattempts fork
+    int attempts = 0;
+
+    // Fork off to child process
+    *spawnPid = fork();
+
+    // Due to server crashes, program reattempts fork
+    while(*spawnPid == -1 && attempts < 45)
+    {
+        sleep(1);
+        *spawnPid = fork();
+        attempts ++;
+        printf("bash: fork: retry: Resource temporarily unavailable - Attempting to reconnect\n");
+        fflush(stdout);
+    }
+
+    // If fork fails
+    if(*spawnPid == -1)
+    {
+        perror("fork() failed!\n");
+        fflush(stdout);
+    }
+
+    // Also set in the parent so the group exists before anything signals it
+    else if(*spawnPid > 0 && group != -1)
+    {
+        setpgid(*spawnPid, group == 0 ? *spawnPid : group);
+    }
+
+    // If fork is sucessful
+    else if(*spawnPid == 0)
+    {
+        // Turn off all signal inputs for TSTP for child
+        SIGTSTP_action.sa_handler = SIG_IGN;
+        sigfillset(&SIGTSTP_action.sa_mask);
+        sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+
+        // Unblock what the shell reads through its signalfd
+        sigprocmask(SIG_UNBLOCK, &shellSignals, NULL);
+        signal(SIGTTOU, SIG_DFL);
+
+        // Jobs get a process group of their own
+        if(group != -1)
+        {
+            setpgid(0, group);
+        }
+
+        // Redirect stdin to source file
+        if(sourceFD != -1 && dup2(sourceFD, 0) == -1)
+        {
+            perror("source dup2()"); 
+            _exit(2); 
+        }
+
+        // Redirect stdout to target file
+        if(targetFD != -1 && dup2(targetFD, 1) == -1)
+        {
+            perror("target dup2()"); 
+            _exit(1); 
+        }
+        if(errorFD != -1 && dup2(errorFD, 2) == -1)
+        {
+            perror("error dup2()"); 
+            _exit(1); 
+        }
+
+        // Check background status
+        if(backGround == false)
+        {
+            SIGINT_action.sa_handler = SIG_DFL;
+            sigfillset(&SIGINT_action.sa_mask);
+            sigaction(SIGINT, &SIGINT_action, NULL);
+        }
+
+        // CPUs, scheduling and I/O priority (see policy and cpus)
+        if(policyActive(currentPolicy) == true)
+        {
+            applyPolicy(currentPolicy);
+        }
+
+        // Execute command
+        execv(path, argv);
+        printf("no such file or directory\n");
+        fflush(stdout);
+        _exit(1);
+    }
+}
+
+int spawnProcess(const char *path, char **argv, int sourceFD, int targetFD, int errorFD, bool backGround, pid_t group, pid_t *spawnPid)
+/***************************************************************************
+*   Description -
+*       Launches a child with posix_spawn(), which glibc implements with
+*       vfork semantics (CLONE_VM | CLONE_VFORK) so the shell's page tables
+*       are never copied.
+*
+*       Redirections are expressed as dup2 file actions on descriptors the
+*       parent already opened. Foreground children get SIGINT reset to its
+*       default action through the spawn attributes. exec() resets caught
+*       signals to SIG_DFL, so to hand the child an ignored SIGTSTP the
+*       handler is swapped for SIG_IGN (with SIGTSTP blocked) for the
+*       duration of the spawn only.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *path                - Resolved executable
+*       char **argv                     - NULL terminated arguement vector
+*       int sourceFD                    - Opened input file or -1
+*       int targetFD                    - Opened output file or -1
+*       int errorFD                     - stderr for the child or -1
+*       bool backGround                 - Child runs in the background
+*       pid_t group                     - Process group (see launchProcess)
+*       pid_t *spawnPid                 - Set to the child pid
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       0 on success, otherwise the error number from posix_spawn()
+****************************************************************************/
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // Redirections were opened by the parent, the child only needs dup2
+    if(sourceFD != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, sourceFD, 0);
+    }
+    if(targetFD != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, targetFD, 1);
+    }
+    if(errorFD != -1)
+    {
+        posix_spawn_file_actions_adddup2(&actions, errorFD, 2);
+    }
+
+    short flags = POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    // The shell keeps its signals blocked for the signalfd, children
+    // start with none blocked. SIGTSTP stays ignored (inherited)
+    sigset_t childMask;
+    sigemptyset(&childMask);
+    posix_spawnattr_setsigmask(&attr, &childMask);
+
+    // Foreground children must terminate on SIGINT. SIGTTOU is only
+    // ignored for the shell's own tcsetpgrp()
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGTTOU);
+    if(backGround == false)
+    {
+        sigaddset(&defaults, SIGINT);
+    }
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    flags |= POSIX_SPAWN_SETSIGDEF;
+
+    // Jobs get a process group of their own
+    if(group != -1)
+    {
+        posix_spawnattr_setpgroup(&attr, group);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    int result = posix_spawn(spawnPid, path, &actions, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return result;
+}
+
+bool openRedirections(struct command *ourCommand, int *sourceFD, int *targetFD)
+/***************************************************************************
+*   Description -
+*       Opens the [< input_file] and [> output_file] of a command in the 
+*       shell so launching only needs dup2. Descriptors are close-on-exec.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Command structre
+*       int *sourceFD                   - Set to the input file or -1
+*       int *targetFD                   - Set to the output file or -1
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       bool                            - false if a file could not be opened
+****************************************************************************/
+{
+    *sourceFD = -1;
+    *targetFD = -1;
+    if(ourCommand->inputFile != NULL)
+    {
+        *sourceFD = open(ourCommand->inputFile, O_RDONLY | O_CLOEXEC);
+        if (*sourceFD == -1) 
+        { 
+            printf("cannot open %s for input\n", ourCommand->inputFile);
+            fflush(stdout);
+            return false;
+        }
+    }
+
+    if(ourCommand->outputFile != NULL)
+    {
+        *targetFD = open(ourCommand->outputFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (*targetFD == -1) 
+        { 
+            printf("cannot open %s for output\n", ourCommand->outputFile); 
+            fflush(stdout);
+            if(*sourceFD != -1)
+            {
+                close(*sourceFD);
+                *sourceFD = -1;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+pid_t launchProcess(char **arguement, int sourceFD, int targetFD, int errorFD, bool backGround, pid_t group, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Starts one external command. The executable is resolved through the 
+*       resolved command table (see resolvePath), a remembered path that no 
+*       longer executes is forgotten and looked up once more. posix_spawn() 
+*       is used first, a full fork() only when spawning is not possible.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       char **arguement                - NULL terminated arguement vector
+*       int sourceFD                    - stdin for the child or -1
+*       int targetFD                    - stdout for the child or -1
+*       int errorFD                     - stderr for the child or -1
+*       bool backGround                 - Child runs in the background
+*       pid_t group                     - Process group to join, 0 to lead
+*                                         a new one, -1 to stay in the 
+*                                         shell's (foreground commands)
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       pid_t                           - Child pid, -1 if nothing started
+****************************************************************************/
+{
+    pid_t spawnPid = -1;
+    fflush(stdout);
+
+    const char *path = resolvePath(arguement[0]);
+    int result = ENOENT;
+    // posix_spawn() can't set affinity, nice or I/O priority in the child
+    if(path != NULL && policyActive(currentPolicy) == true)
+    {
+        result = ENOSYS;
+    }
+    else if(path != NULL)
+    {
+        result = spawnProcess(path, arguement, sourceFD, targetFD, errorFD, backGround, group, &spawnPid);
+        if((result == ENOENT || result == EACCES || result == ENOTDIR) && path != arguement[0])
+        {
+            forgetPath(arguement[0]);
+            path = resolvePath(arguement[0]);
+            if(path != NULL)
+            {
+                result = spawnProcess(path, arguement, sourceFD, targetFD, errorFD, backGround, group, &spawnPid);
+            }
+        }
+    }
+
+    // Out of resources, unsupported or a policy to apply: full fork()
+    if(result == EAGAIN || result == ENOMEM || result == ENOSYS)
+    {
+        forkProcess(path, arguement, sourceFD, targetFD, errorFD, backGround, group, &spawnPid, SIGINT_action, SIGTSTP_action);
+    }
+    // Command could not be executed
+    else if(result != 0)
+    {
+        printf("no such file or directory\n");
+        fflush(stdout);
+        spawnPid = -1;
+    }
+    return spawnPid;
+}
+
+void jobsProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The jobs command lists every live background job with its id, 
+*       state, pid of its last stage and command line.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements (unused)
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    reapProcesses(false);
+    for(int x = 0; x < jobCapacity; x++)
+    {
+        if(jobSlab[x].used == true)
+        {
+            printf("[%d] %-8s %d  %s\n", x + 1, jobSlab[x].stopped ? "Stopped" : "Running",
+                   jobSlab[x].pids[jobSlab[x].count - 1], jobSlab[x].text);
+        }
+    }
+    fflush(stdout);
+}
+
+void joboutputProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The joboutput command picks how background jobs started from now
+*       on print. 'lines' prefixes every whole line with [id], 'group' 
+*       prints each job's output in one piece, 'off' leaves the jobs 
+*       writing to the terminal. Without an arguement the mode is printed.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    static const char *modes[] = {"off", "lines", "group"};
+    const char *mode = ourCommand->arguements[0];
+    if(mode == NULL)
+    {
+        printf("joboutput %s\n", modes[jobOutputMode]);
+        fflush(stdout);
+        *FGS = 0;
+        return;
+    }
+    for(int x = 0; x < 3; x++)
+    {
+        if(strcmp(mode, modes[x]) == 0 && ourCommand->arguements[1] == NULL)
+        {
+            jobOutputMode = x;
+            *FGS = 0;
+            return;
+        }
+    }
+    printf("usage: joboutput [lines|group|off]\n");
+    fflush(stdout);
+    *FGS = 1;
+}
+
+int waitJob(int index, bool report)
+/***************************************************************************
+*   Description -
+*       Blocks until every remaining process of a job has exited or the
+*       job stops. The job record is freed once it is done.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int index               - Slab index of the job
+*       bool report             - Print exit messages like the reaper
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Wait status of the last stage, -1 if the
+*                                 job stopped instead
+****************************************************************************/
+{
+    while(jobSlab[index].used == true)
+    {
+        // Pick any process of the job that has not been reaped yet
+        pid_t pid = 0;
+        for(int x = 0; x < jobSlab[index].count; x++)
+        {
+            if(findJob(jobSlab[index].pids[x]) == index)
+            {
+                pid = jobSlab[index].pids[x];
+                break;
+            }
+        }
+        int childStatus;
+        struct rusage childUsage;
+        if(pid == 0 || waitEvent(pid, &childStatus, WUNTRACED, &childUsage) == -1)
+        {
+            // Reaped elsewhere, nothing left to wait for
+            int status = jobSlab[index].lastStatus;
+            removeJob(index);
+            return status;
+        }
+        int status = jobSlab[index].lastStatus;
+        if(pid == jobSlab[index].pids[jobSlab[index].count - 1])
+        {
+            status = childStatus;
+        }
+        bool last = jobSlab[index].running == 1;
+        collectProcess(pid, childStatus, &childUsage, report);
+        if(WIFSTOPPED(childStatus))
+        {
+            return -1;
+        }
+        if(last == true)
+        {
+            return status;
+        }
+    }
+    return 0;
+}
+
+void waitProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The wait command blocks until the given job (wait id) or every 
+*       running background job (wait) has finished, reporting each one.
+*       The status of the last job waited on becomes the exit status.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(ourCommand->arguements[0] != NULL)
+    {
+        int index = jobIndex(ourCommand, "wait");
+        if(index == -1)
+        {
+            *FGS = 127;
+            return;
+        }
+        int status = waitJob(index, true);
+        if(status != -1)
+        {
+            *FGS = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        fflush(stdout);
+        return;
+    }
+
+    // Any child will do, each result goes through the job table
+    while(jobsRunning > 0)
+    {
+        int childStatus;
+        struct rusage childUsage;
+        pid_t PID = waitEvent(-1, &childStatus, WUNTRACED, &childUsage);
+        if(PID == -1)
+        {
+            break;
+        }
+        collectProcess(PID, childStatus, &childUsage, true);
+    }
+    *FGS = 0;
+    fflush(stdout);
+}
+
+void fgProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The fg command moves a job (fg id, or the most recent job) to the
+*       foreground: it is continued if stopped and waited on like any 
+*       foreground command.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    int index = jobIndex(ourCommand, "fg");
+    if(index == -1)
+    {
+        return;
+    }
+    printf("%s\n", jobSlab[index].text);
+    fflush(stdout);
+
+    // The job's group gets the terminal while it runs, then it comes back
+    pid_t group = jobSlab[index].pids[0];
+    if(lineEditing == true)
+    {
+        tcsetpgrp(STDIN_FILENO, group);
+    }
+    kill(-group, SIGCONT);
+    int childStatus = waitJob(index, false);
+    if(lineEditing == true)
+    {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    if(childStatus == -1)
+    {
+        return;
+    }
+    // The job finished in the foreground, its usage counts as foreground
+    foregroundUsage = jobUsage;
+    foregroundUsage.text = NULL;
+    foregroundRuns ++;
+    if(WIFEXITED(childStatus) != 1)
+    {
+        printf("terminated by signal %d\n",  WTERMSIG(childStatus));
+        fflush(stdout);
+    }
+    *FGS = WEXITSTATUS(childStatus);
+}
+
+void bgProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       The bg command continues a stopped job (bg id, or the most recent
+*       job) in the background.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status (unused)
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    int index = jobIndex(ourCommand, "bg");
+    if(index == -1)
+    {
+        return;
+    }
+    kill(-jobSlab[index].pids[0], SIGCONT);
+    if(jobSlab[index].stopped == true)
+    {
+        jobSlab[index].stopped = false;
+        jobsRunning ++;
+    }
+    printf("[%d] %s\n", index + 1, jobSlab[index].text);
+    fflush(stdout);
+}
+
+void timeStart(struct command *ourCommand, struct usage *timer)
+/***************************************************************************
+*   Description -
+*       Handles the time keyword (time command [arg1 ...]): strips it from
+*       a copy of the first stage so the rest of the line runs as usual 
+*       and starts timing. The shell's
+*       own usage so far is kept in the timer to be subtracted later.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Line starting with time
+*       struct usage *timer             - Timer to start
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    ourCommand->argv ++;
+    ourCommand->arguements = ourCommand->argv[0] != NULL ? ourCommand->argv + 1 : ourCommand->argv;
+    ourCommand->commandType = ourCommand->argv[0] != NULL ? ourCommand->argv[0] : "Blank";
+    startUsage(timer);
+    getrusage(RUSAGE_SELF, &timer->rusage);
+}
+
+void timeReport(struct usage *timer, int runsBefore)
+/***************************************************************************
+*   Description -
+*       Prints what a timed line used to stderr: wall time, the shell's 
+*       own CPU time (built ins) plus everything its foreground processes
+*       used. Max RSS is the foreground process's if one ran, else the
+*       shell's.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct usage *timer             - Timer from timeStart
+*       int runsBefore                  - foregroundRuns when timing began
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    struct usage result;
+    result.started = timer->started;
+    result.text = NULL;
+    result.rusage = self;
+    timersub(&self.ru_utime, &timer->rusage.ru_utime, &result.rusage.ru_utime);
+    timersub(&self.ru_stime, &timer->rusage.ru_stime, &result.rusage.ru_stime);
+    result.rusage.ru_minflt -= timer->rusage.ru_minflt;
+    result.rusage.ru_majflt -= timer->rusage.ru_majflt;
+    result.rusage.ru_nvcsw -= timer->rusage.ru_nvcsw;
+    result.rusage.ru_nivcsw -= timer->rusage.ru_nivcsw;
+    if(foregroundRuns != runsBefore)
+    {
+        result.rusage.ru_maxrss = 0;
+    }
+    struct rusage none = {{0}};
+    addUsage(&result, foregroundRuns != runsBefore ? &foregroundUsage.rusage : &none);
+
+    fflush(stdout);
+    printUsage(stderr, "time", &result);
+}
+
+struct builtin
+/**************************************************************************
+*   Description -
+*       Entry of the built in registry. Native entries stand in for an 
+*       external utility of the same name: they honor < and >, set the 
+*       exit status and still launch the real utility when run in the 
+*       background.
+*   -----------------------------------------------------------------------
+*    const char *name       - Command name
+*    void (*run)()          - Implementation, NULL when main() handles it
+*    bool native            - Stand in for an external utility
+*
+***************************************************************************/
+{
+    const char *name;
+    void (*run)(struct command *ourCommand, int* FGS);
+    bool native;
+};
+
+// Every command the shell handles itself
+const struct builtin builtins[] = {
+    {"exit",        NULL,               false},
+    {"cd",          cdProcess,          false},
+    {"status",      statusProcess,      false},
+    {"hash",        hashProcess,        false},
+    {"cache",       cacheProcess,       false},
+    {"policy",      policyProcess,      false},
+    {"timeout",     timeoutProcess,     false},
+    {"audit",       auditProcess,       false},
+    {"history",     historyProcess,     false},
+    {"jobs",        jobsProcess,        false},
+    {"wait",        waitProcess,        false},
+    {"fg",          fgProcess,          false},
+    {"bg",          bgProcess,          false},
+    {"joboutput",   joboutputProcess,   false},
+    {"parallel",    NULL,               false},
+    {"dag",         NULL,               false},
+    {"echo",        echoProcess,        true},
+    {"true",        trueProcess,        true},
+    {"false",       falseProcess,       true},
+    {"pwd",         pwdProcess,         true},
+    {"test",        testProcess,        true},
+    {"[",           testProcess,        true},
+};
+
+const struct builtin *findBuiltin(const char *name)
+/***************************************************************************
+*   Description -
+*       Looks a command up in the built in registry
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *name                - Command name
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       const struct builtin *          - Registry entry, NULL if external
+****************************************************************************/
+{
+    for(size_t x = 0; x < sizeof(builtins) / sizeof(builtins[0]); x++)
+    {
+        if(builtins[x].name[0] == name[0] && strcmp(builtins[x].name, name) == 0)
+        {
+            return &builtins[x];
+        }
+    }
+    return NULL;
+}
+
+bool isBuiltin(const char *name)
+/***************************************************************************
+*   Description -
+*       Checks whether a command is handled by the shell itself
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *name                - Command name
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       bool                            - true for anything in builtins[]
+****************************************************************************/
+{
+    return findBuiltin(name) != NULL;
+}
+
+void parallelProcess(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*   The parallel command runs a list of command lines with at most N of 
+*   them at a time (parallel [-j N] [file]). Lines come from file or, 
+*   without one, from the shell's own input up to its end or a line 
+*   reading end. N defaults to the number of online CPUs.
+*   
+*   Each line is parsed with parseBuffer(), patterns expanded, and started
+*   through launchProcess() as a foreground command with stdin from /dev/null 
+*   unless redirected. The next line starts as soon as any child exits.
+*   Native built ins launch the real utility, other built ins, pipelines
+*   and $(command) are not run.
+*   
+*   Every line runs under the time limit of the parallel line (timeout 
+*   prefix or timeout -d), one that runs out counts as failed.
+*   
+*   Failed lines are reported by line number. The exit status is the 
+*   number of failed lines (at most 255).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+{
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *fileName = NULL;
+    for(char **arguement = ourCommand->arguements; *arguement != NULL; arguement++)
+    {
+        if(strcmp(*arguement, "-j") == 0 && arguement[1] != NULL)
+        {
+            arguement ++;
+            slots = atol(*arguement);
+        }
+        else if(strncmp(*arguement, "-j", 2) == 0)
+        {
+            slots = atol(*arguement + 2);
+        }
+        else
+        {
+            fileName = *arguement;
+        }
+    }
+    if(slots < 1)
+    {
+        slots = 1;
+    }
+
+    struct lineReader fileReader;
+    struct lineReader *reader = &inputReader;
+    if(fileName != NULL)
+    {
+        int fileFD = open(fileName, O_RDONLY | O_CLOEXEC);
+        if(fileFD == -1)
+        {
+            printf("parallel: cannot open %s\n", fileName);
+            fflush(stdout);
+            *FGS = 1;
+            return;
+        }
+        openReader(&fileReader, fileFD);
+        reader = &fileReader;
+    }
+
+    // Children that are running, with the line that started them and
+    // its deadline. A slot keeps its place while its child runs (the 
+    // deadline's timer is watched), free slots hold pid -1
+    pid_t *runningPid = malloc(slots * sizeof(pid_t));
+    int *runningLine = malloc(slots * sizeof(int));
+    char **runningAudit = malloc(slots * sizeof(char *));
+    struct deadline *runningLimit = malloc(slots * sizeof(struct deadline));
+    for(int x = 0; x < slots; x++)
+    {
+        runningPid[x] = -1;
+    }
+    int running = 0;
+    int lineNumber = 0;
+    int failed = 0;
+    bool more = true;
+    int nullFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    struct arena lineArena = {0};
+    struct usage commandUsage;
+    startUsage(&commandUsage);
+
+    while(more == true || running > 0)
+    {
+        // Fill every free slot
+        while(more == true && running < slots)
+        {
+            const char *line;
+            size_t length;
+            if(readLine(reader, &line, &length) == false ||
+               (fileName == NULL && length == 3 && memcmp(line, "end", 3) == 0))
+            {
+                more = false;
+                break;
+            }
+            lineNumber ++;
+            arenaReset(&lineArena);
+            struct command *lineCommand = parseBuffer(line, length, &lineArena);
+            if(lineCommand->glob == true && (lineCommand = globCommand(lineCommand, &lineArena)) == NULL)
+            {
+                failed ++;
+                continue;
+            }
+            if(strcmp(lineCommand->commandType, "Blank") == 0)
+            {
+                continue;
+            }
+            const struct builtin *builtin = findBuiltin(lineCommand->commandType);
+            if(lineCommand->next != NULL || (builtin != NULL && builtin->native == false))
+            {
+                printf("parallel: line %d: only external commands can run\n", lineNumber);
+                failed ++;
+                continue;
+            }
+            // Substitution runs lines of its own, it is only done at the 
+            // shell's top level
+            if(lineCommand->substitute == true)
+            {
+                printf("parallel: line %d: $(command) is not supported\n", lineNumber);
+                failed ++;
+                continue;
+            }
+
+            int sourceFD;
+            int targetFD;
+            pid_t spawnPid = -1;
+            struct timespec started;
+            clock_gettime(CLOCK_REALTIME, &started);
+            if(openRedirections(lineCommand, &sourceFD, &targetFD) == true)
+            {
+                spawnPid = launchProcess(lineCommand->argv, sourceFD != -1 ? sourceFD : nullFD, targetFD, -1, false, listGroup(), SIGINT_action, SIGTSTP_action);
+                if(sourceFD != -1)
+                {
+                    close(sourceFD);
+                }
+                if(targetFD != -1)
+                {
+                    close(targetFD);
+                }
+            }
+            if(spawnPid == -1)
+            {
+                failed ++;
+                continue;
+            }
+            int slot = 0;
+            while(runningPid[slot] != -1)
+            {
+                slot ++;
+            }
+            runningPid[slot] = spawnPid;
+            runningLine[slot] = lineNumber;
+            runningAudit[slot] = auditHead(lineCommand, spawnPid, false, &started);
+            startDeadline(&runningLimit[slot], &runningPid[slot], 1, listGroup() == 0 ? spawnPid : -1);
+            running ++;
+        }
+        if(running == 0)
+        {
+            continue;
+        }
+
+        // A slot frees up with whichever child exits first
+        int childStatus;
+        struct rusage childUsage;
+        pid_t PID = waitEvent(-1, &childStatus, 0, &childUsage);
+        if(PID == -1)
+        {
+            break;
+        }
+        int slot = 0;
+        while(slot < slots && runningPid[slot] != PID)
+        {
+            slot ++;
+        }
+        // Background job of the shell
+        if(slot == slots)
+        {
+            collectProcess(PID, childStatus, &childUsage, true);
+            continue;
+        }
+        runningPid[slot] = -1;
+        running --;
+        addUsage(&commandUsage, &childUsage);
+        auditFinish(runningAudit[slot], childStatus);
+        if(stopDeadline(&runningLimit[slot]) == true)
+        {
+            printf("parallel: line %d timed out after %gs, status %d\n", runningLine[slot], lineTimeout, TIMEOUT_STATUS);
+            failed ++;
+        }
+        else if(WIFEXITED(childStatus) != 1)
+        {
+            printf("parallel: line %d terminated by signal %d\n", runningLine[slot], WTERMSIG(childStatus));
+            failed ++;
+        }
+        else if(WEXITSTATUS(childStatus) != 0)
+        {
+            printf("parallel: line %d exited with status %d\n", runningLine[slot], WEXITSTATUS(childStatus));
+            failed ++;
+        }
+    }
+    fflush(stdout);
+
+    if(reader == &fileReader)
+    {
+        closeReader(&fileReader);
+    }
+    close(nullFD);
+    arenaReset(&lineArena);
+    free(lineArena.block);
+    for(int x = 0; x < slots; x++)
+    {
+        if(runningPid[x] != -1)
+        {
+            stopDeadline(&runningLimit[x]);
+            free(runningAudit[x]);
+        }
+    }
+    free(runningPid);
+    free(runningLine);
+    free(runningAudit);
+    free(runningLimit);
+    foregroundUsage = commandUsage;
+    foregroundRuns ++;
+    // The status counts lines, a timed out one is not the whole command
+    foregroundTimedOut = false;
+    *FGS = failed < 255 ? failed : 255;
+}
+
+// States of a dag task
+#define TASK_WAITING 0              // Needs have not all finished
+#define TASK_READY 1                // Can start when a slot frees up
+#define TASK_RUNNING 2
+#define TASK_DONE 3
+#define TASK_FAILED 4
+#define TASK_SKIPPED 5              // A task it needs failed
+
+struct task
+/**************************************************************************
+*   Description -
+*       Task of a dag file, a command line that starts once every task it
+*       needs has succeeded. needs and dependents are ranges of shared 
+*       index arrays.
+*   -----------------------------------------------------------------------
+*    char *name             - Task name
+*    char *line             - Command line
+*    int lineNumber         - Line of the file it came from
+*    int needStart          - First entry in needIndex
+*    int needCount          - Tasks it needs
+*    int dependentStart     - First entry in dependentIndex
+*    int dependentCount     - Tasks that need it
+*    int waiting            - Needs that have not finished
+*    int height             - Tasks on the longest chain from here to 
+*                             the end of the graph, itself included
+*    int state              - TASK_WAITING ...
+*    int after              - Need that finished last and let it start,
+*                             -1 if it needed nothing
+*    pid_t pid              - Process while running, -1 once reaped
+*    struct deadline limit  - Time limit while running
+*    char *audit            - Audit record head while running
+*    double start           - Seconds from the start of the run, -1 if
+*                             it never started
+*    double finish          - Seconds from the start of the run
+*
+***************************************************************************/
+{
+    char *name;
+    char *line;
+    int lineNumber;
+    int needStart;
+    int needCount;
+    int dependentStart;
+    int dependentCount;
+    int waiting;
+    int height;
+    int state;
+    int after;
+    pid_t pid;
+    struct deadline limit;
+    char *audit;
+    double start;
+    double finish;
+};
+
+double secondsSince(const struct timespec *origin)
+/***************************************************************************
+*   Description -
+*       Monotonic seconds elapsed since origin
+****************************************************************************/
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - origin->tv_sec) + (now.tv_nsec - origin->tv_nsec) / 1e9;
+}
+
+int compareTasks(const void *left, const void *right, void *tasks)
+/***************************************************************************
+*   Description -
+*       qsort_r() order of task indices by name
+****************************************************************************/
+{
+    struct task *task = tasks;
+    return strcmp(task[*(const int *)left].name, task[*(const int *)right].name);
+}
+
+int findTask(struct task *tasks, const int *byName, int count, const char *name)
+/***************************************************************************
+*   Description -
+*       Binary search of the name ordered task index
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct task *tasks          - Tasks
+*       const int *byName           - Task indices ordered by name
+*       int count                   - Number of tasks
+*       const char *name            - Name to look for
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                          - Task index, -1 if there is none
+****************************************************************************/
+{
+    int low = 0;
+    int high = count - 1;
+    while(low <= high)
+    {
+        int middle = (low + high) / 2;
+        int order = strcmp(tasks[byName[middle]].name, name);
+        if(order == 0)
+        {
+            return byName[middle];
+        }
+        if(order < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+bool readTasks(struct lineReader *reader, bool untilEnd, struct arena *taskArena, struct task **tasks, int *count, char ***needName)
+/***************************************************************************
+*   Description -
+*       Reads the tasks of a dag file, one per line:
+*           NAME [NEEDS ...]: COMMAND
+*       The colon may also stand alone. Blank lines and # comments are 
+*       skipped. Names and lines are copied to taskArena, needed names 
+*       go to needName in order, task by task.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Where the tasks come from
+*       bool untilEnd               - A line reading end finishes the list
+*       struct arena *taskArena     - Holds names and lines
+*       struct task **tasks         - Set to the malloc'd tasks
+*       int *count                  - Set to the number of tasks
+*       char ***needName            - Set to the malloc'd needed names
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false (reported) for a bad line
+****************************************************************************/
+{
+    int capacity = 0;
+    int needs = 0;
+    int needCapacity = 0;
+    int lineNumber = 0;
+    bool valid = true;
+    const char *line;
+    size_t length;
+    *tasks = NULL;
+    *needName = NULL;
+    *count = 0;
+    while(valid == true && readLine(reader, &line, &length) == true)
+    {
+        lineNumber ++;
+        if(untilEnd == true && length == 3 && memcmp(line, "end", 3) == 0)
+        {
+            break;
+        }
+        const char *scan = line;
+        const char *end = line + length;
+        while(scan < end && (*scan == ' ' || *scan == '\t'))
+        {
+            scan ++;
+        }
+        if(scan == end || *scan == '#')
+        {
+            continue;
+        }
+
+        if(*count == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            *tasks = realloc(*tasks, capacity * sizeof(struct task));
+        }
+        struct task *task = &(*tasks)[*count];
+        memset(task, 0, sizeof(struct task));
+        task->lineNumber = lineNumber;
+        task->needStart = needs;
+
+        // Words up to the one ending in a colon: the name, then its needs
+        bool listed = false;
+        while(listed == false && scan < end)
+        {
+            const char *word = scan;
+            while(scan < end && *scan != ' ' && *scan != '\t')
+            {
+                scan ++;
+            }
+            size_t wordLength = scan - word;
+            if(word[wordLength - 1] == ':')
+            {
+                wordLength --;
+                listed = true;
+            }
+            while(scan < end && (*scan == ' ' || *scan == '\t'))
+            {
+                scan ++;
+            }
+            if(wordLength == 0)
+            {
+                continue;
+            }
+            char *copy = arenaAlloc(taskArena, wordLength + 1);
+            memcpy(copy, word, wordLength);
+            copy[wordLength] = '\0';
+            if(task->name == NULL)
+            {
+                task->name = copy;
+                continue;
+            }
+            if(needs == needCapacity)
+            {
+                needCapacity = needCapacity == 0 ? 64 : needCapacity * 2;
+                *needName = realloc(*needName, needCapacity * sizeof(char *));
+            }
+            (*needName)[needs++] = copy;
+        }
+        if(task->name == NULL || listed == false || scan == end)
+        {
+            printf("dag: line %d: expected NAME [NEEDS ...]: COMMAND\n", lineNumber);
+            valid = false;
+            break;
+        }
+        task->needCount = needs - task->needStart;
+        task->line = arenaAlloc(taskArena, end - scan + 1);
+        memcpy(task->line, scan, end - scan);
+        task->line[end - scan] = '\0';
+        (*count) ++;
+    }
+    return valid;
+}
+
+bool linkTasks(struct task *tasks, int count, char **needName, int **needIndex, int **dependentIndex)
+/***************************************************************************
+*   Description -
+*       Resolves needed names to tasks, fills in who depends on whom and
+*       checks the graph. Heights come from a topological order (Kahn),
+*       which also finds cycles: tasks on or after one never get there.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct task *tasks          - Tasks from readTasks()
+*       int count                   - Number of tasks
+*       char **needName             - Needed names from readTasks()
+*       int **needIndex             - Set to the malloc'd needed tasks
+*       int **dependentIndex        - Set to the malloc'd dependents
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false (reported) if a name is 
+*                                     unknown or repeated, or for a cycle
+****************************************************************************/
+{
+    int needs = count > 0 ? tasks[count - 1].needStart + tasks[count - 1].needCount : 0;
+    *needIndex = malloc((needs + 1) * sizeof(int));
+    *dependentIndex = malloc((needs + 1) * sizeof(int));
+    int *byName = malloc((count + 1) * sizeof(int));
+    int *order = malloc((count + 1) * sizeof(int));
+    bool valid = true;
+
+    for(int x = 0; x < count; x++)
+    {
+        byName[x] = x;
+    }
+    qsort_r(byName, count, sizeof(int), compareTasks, tasks);
+    for(int x = 1; x < count; x++)
+    {
+        if(strcmp(tasks[byName[x - 1]].name, tasks[byName[x]].name) == 0)
+        {
+            printf("dag: line %d: task %s is already defined\n", tasks[byName[x]].lineNumber, tasks[byName[x]].name);
+            valid = false;
+        }
+    }
+
+    // Needs by index, then each task's dependents as a range
+    for(int x = 0; valid == true && x < count; x++)
+    {
+        for(int y = tasks[x].needStart; y < tasks[x].needStart + tasks[x].needCount; y++)
+        {
+            (*needIndex)[y] = findTask(tasks, byName, count, needName[y]);
+            if((*needIndex)[y] == -1)
+            {
+                printf("dag: line %d: %s needs unknown task %s\n", tasks[x].lineNumber, tasks[x].name, needName[y]);
+                valid = false;
+            }
+            else
+            {
+                tasks[(*needIndex)[y]].dependentCount ++;
+            }
+        }
+    }
+    if(valid == true)
+    {
+        int start = 0;
+        for(int x = 0; x < count; x++)
+        {
+            tasks[x].dependentStart = start;
+            start += tasks[x].dependentCount;
+            tasks[x].dependentCount = 0;
+        }
+        for(int x = 0; x < count; x++)
+        {
+            for(int y = tasks[x].needStart; y < tasks[x].needStart + tasks[x].needCount; y++)
+            {
+                struct task *need = &tasks[(*needIndex)[y]];
+                (*dependentIndex)[need->dependentStart + need->dependentCount++] = x;
+            }
+        }
+
+        // Topological order, roots first
+        int ordered = 0;
+        for(int x = 0; x < count; x++)
+        {
+            tasks[x].waiting = tasks[x].needCount;
+            if(tasks[x].waiting == 0)
+            {
+                order[ordered++] = x;
+            }
+        }
+        for(int x = 0; x < ordered; x++)
+        {
+            struct task *task = &tasks[order[x]];
+            for(int y = task->dependentStart; y < task->dependentStart + task->dependentCount; y++)
+            {
+                if(--tasks[(*dependentIndex)[y]].waiting == 0)
+                {
+                    order[ordered++] = (*dependentIndex)[y];
+                }
+            }
+        }
+        if(ordered < count)
+        {
+            printf("dag: dependency cycle, these tasks can never start:");
+            for(int x = 0; x < count; x++)
+            {
+                if(tasks[x].waiting > 0)
+                {
+                    printf(" %s", tasks[x].name);
+                }
+            }
+            printf("\n");
+            valid = false;
+        }
+
+        // Heights, leaves first
+        for(int x = ordered - 1; x >= 0; x--)
+        {
+            struct task *task = &tasks[order[x]];
+            task->height = 1;
+            for(int y = task->dependentStart; y < task->dependentStart + task->dependentCount; y++)
+            {
+                if(tasks[(*dependentIndex)[y]].height + 1 > task->height)
+                {
+                    task->height = tasks[(*dependentIndex)[y]].height + 1;
+                }
+            }
+        }
+    }
+    free(byName);
+    free(order);
+    return valid;
+}
+
+pid_t launchTask(struct task *task, struct arena *lineArena, int nullFD, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Starts a task like parallel starts a line: parsed with 
+*       parseBuffer(), patterns expanded, launched through launchProcess() in the foreground
+*       with stdin from /dev/null unless redirected. Native built ins 
+*       launch the real utility, other built ins, pipelines and 
+*       $(command) cannot run.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct task *task               - Task to start
+*       struct arena *lineArena         - Holds the parsed line
+*       int nullFD                      - /dev/null
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      pid_t                            - Child pid, -1 if it did not start
+****************************************************************************/
+{
+    arenaReset(lineArena);
+    struct command *taskCommand = parseBuffer(task->line, strlen(task->line), lineArena);
+    if(taskCommand->glob == true && (taskCommand = globCommand(taskCommand, lineArena)) == NULL)
+    {
+        return -1;
+    }
+    const struct builtin *builtin = findBuiltin(taskCommand->commandType);
+    if(taskCommand->next != NULL || (builtin != NULL && builtin->native == false) ||
+       strcmp(taskCommand->commandType, "Blank") == 0)
+    {
+        printf("dag: %s: only external commands can run\n", task->name);
+        return -1;
+    }
+    if(taskCommand->substitute == true)
+    {
+        printf("dag: %s: $(command) is not supported\n", task->name);
+        return -1;
+    }
+
+    int sourceFD;
+    int targetFD;
+    pid_t spawnPid = -1;
+    struct timespec started;
+    clock_gettime(CLOCK_REALTIME, &started);
+    if(openRedirections(taskCommand, &sourceFD, &targetFD) == true)
+    {
+        spawnPid = launchProcess(taskCommand->argv, sourceFD != -1 ? sourceFD : nullFD, targetFD, -1, false, listGroup(), SIGINT_action, SIGTSTP_action);
+        if(sourceFD != -1)
+        {
+            close(sourceFD);
+        }
+        if(targetFD != -1)
+        {
+            close(targetFD);
+        }
+    }
+    if(spawnPid != -1)
+    {
+        task->audit = auditHead(taskCommand, spawnPid, false, &started);
+    }
+    return spawnPid;
+}
+
+int skipDependents(struct task *tasks, const int *dependentIndex, int failed)
+/***************************************************************************
+*   Description -
+*       Marks everything that needs a failed task, directly or not, as 
+*       skipped
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct task *tasks          - Tasks
+*       const int *dependentIndex   - Dependents from linkTasks()
+*       int failed                  - Index of the failed task
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                          - Number of tasks skipped
+****************************************************************************/
+{
+    int skipped = 0;
+    int capacity = 16;
+    int depth = 0;
+    int *stack = malloc(capacity * sizeof(int));
+    stack[depth++] = failed;
+    while(depth > 0)
+    {
+        struct task *task = &tasks[stack[--depth]];
+        for(int y = task->dependentStart; y < task->dependentStart + task->dependentCount; y++)
+        {
+            struct task *dependent = &tasks[dependentIndex[y]];
+            if(dependent->state != TASK_WAITING)
+            {
+                continue;
+            }
+            dependent->state = TASK_SKIPPED;
+            skipped ++;
+            if(depth == capacity)
+            {
+                capacity *= 2;
+                stack = realloc(stack, capacity * sizeof(int));
+            }
+            stack[depth++] = dependentIndex[y];
+        }
+    }
+    free(stack);
+    return skipped;
+}
+
+void dagSummary(struct task *tasks, int count, double elapsed)
+/***************************************************************************
+*   Description -
+*       Prints how the run went and its critical path: the chain of tasks,
+*       each started by the one before finishing, that ended last. 
+*       Shortening anything off this path does not finish the run sooner.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct task *tasks          - Tasks after the run
+*       int count                   - Number of tasks
+*       double elapsed              - Seconds the whole run took
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    int done = 0;
+    int failed = 0;
+    int skipped = 0;
+    int last = -1;
+    int width = 4;
+    for(int x = 0; x < count; x++)
+    {
+        done += tasks[x].state == TASK_DONE;
+        failed += tasks[x].state == TASK_FAILED;
+        skipped += tasks[x].state == TASK_SKIPPED;
+        if(tasks[x].start >= 0 && (last == -1 || tasks[x].finish > tasks[last].finish))
+        {
+            last = x;
+        }
+    }
+    printf("dag: %d tasks, %d done, %d failed, %d skipped, %d not run in %.3fs\n", count, done, 
+           failed, skipped, count - done - failed - skipped, elapsed);
+    if(last == -1)
+    {
+        return;
+    }
+
+    // Walk back from the task that ended last, then print in run order
+    int length = 0;
+    for(int x = last; x != -1; x = tasks[x].after)
+    {
+        length ++;
+        if((int)strlen(tasks[x].name) > width)
+        {
+            width = strlen(tasks[x].name);
+        }
+    }
+    int *path = malloc(length * sizeof(int));
+    int step = length;
+    double busy = 0;
+    for(int x = last; x != -1; x = tasks[x].after)
+    {
+        path[--step] = x;
+        busy += tasks[x].finish - tasks[x].start;
+    }
+    printf("dag: critical path %d tasks, %.3fs running of %.3fs\n", length, busy, tasks[last].finish);
+    for(int x = 0; x < length; x++)
+    {
+        struct task *task = &tasks[path[x]];
+        printf("    %-*s %9.3fs  at %.3fs%s\n", width, task->name, task->finish - task->start, task->start,
+               task->state == TASK_FAILED ? "  failed" : "");
+    }
+    free(path);
+}
+
+void dagProcess(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*   The dag command runs a graph of tasks (dag [-j N] [file]), each task 
+*   starting as soon as every task it needs has succeeded, at most N at a
+*   time. Tasks come from file or, without one, from the shell's own input
+*   up to its end or a line reading end (see readTasks() for the format).
+*   N defaults to the number of online CPUs.
+*   
+*   Of the tasks that are ready, the one heading the longest chain of 
+*   tasks still to come starts first. Tasks are launched like parallel's 
+*   lines. When a task fails, everything that needs it is skipped and the
+*   rest of the graph carries on. Every task runs under the time limit of
+*   the dag line (timeout prefix or timeout -d), one that runs out fails.
+*   A task interrupted by SIGINT stops the run, no more tasks start. 
+*   Background jobs finishing meanwhile go to the job table as usual.
+*   
+*   A summary with the critical path ends the run. The exit status is the
+*   number of failed tasks (at most 255), 1 if the graph cannot run.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Carries our arguements
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+{
+    long slots = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *fileName = NULL;
+    for(char **arguement = ourCommand->arguements; *arguement != NULL; arguement++)
+    {
+        if(strcmp(*arguement, "-j") == 0 && arguement[1] != NULL)
+        {
+            arguement ++;
+            slots = atol(*arguement);
+        }
+        else if(strncmp(*arguement, "-j", 2) == 0)
+        {
+            slots = atol(*arguement + 2);
+        }
+        else
+        {
+            fileName = *arguement;
+        }
+    }
+    if(slots < 1)
+    {
+        slots = 1;
+    }
+
+    struct lineReader fileReader;
+    struct lineReader *reader = &inputReader;
+    if(fileName != NULL)
+    {
+        int fileFD = open(fileName, O_RDONLY | O_CLOEXEC);
+        if(fileFD == -1)
+        {
+            printf("dag: cannot open %s\n", fileName);
+            fflush(stdout);
+            *FGS = 1;
+            return;
+        }
+        openReader(&fileReader, fileFD);
+        reader = &fileReader;
+    }
+
+    struct arena taskArena = {0};
+    struct task *tasks;
+    int count;
+    char **needName;
+    int *needIndex = NULL;
+    int *dependentIndex = NULL;
+    bool valid = readTasks(reader, fileName == NULL, &taskArena, &tasks, &count, &needName) == true &&
+                 linkTasks(tasks, count, needName, &needIndex, &dependentIndex) == true;
+    if(reader == &fileReader)
+    {
+        closeReader(&fileReader);
+    }
+    if(valid == false)
+    {
+        *FGS = 1;
+    }
+
+    // Roots are ready, everything else waits for its needs
+    int *ready = malloc((count + 1) * sizeof(int));
+    int readyCount = 0;
+    for(int x = 0; valid == true && x < count; x++)
+    {
+        tasks[x].waiting = tasks[x].needCount;
+        tasks[x].after = -1;
+        tasks[x].start = -1;
+        tasks[x].state = TASK_WAITING;
+        if(tasks[x].waiting == 0)
+        {
+            tasks[x].state = TASK_READY;
+            ready[readyCount++] = x;
+        }
+    }
+
+    int *running = malloc(slots * sizeof(int));
+    int runningCount = 0;
+    int failed = 0;
+    bool interrupted = false;
+    int nullFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    struct arena lineArena = {0};
+    struct usage commandUsage;
+    startUsage(&commandUsage);
+
+    while(valid == true && (readyCount > 0 || runningCount > 0))
+    {
+        // Fill every free slot, longest chain first
+        while(interrupted == false && readyCount > 0 && runningCount < slots)
+        {
+            int best = 0;
+            for(int x = 1; x < readyCount; x++)
+            {
+                struct task *task = &tasks[ready[x]];
+                if(task->height > tasks[ready[best]].height ||
+                   (task->height == tasks[ready[best]].height && ready[x] < ready[best]))
+                {
+                    best = x;
+                }
+            }
+            int next = ready[best];
+            ready[best] = ready[--readyCount];
+
+            struct task *task = &tasks[next];
+            task->start = secondsSince(&commandUsage.started);
+            task->pid = launchTask(task, &lineArena, nullFD, SIGINT_action, SIGTSTP_action);
+            if(task->pid == -1)
+            {
+                task->finish = task->start;
+                task->state = TASK_FAILED;
+                failed ++;
+                int skipped = skipDependents(tasks, dependentIndex, next);
+                printf("dag: %s did not start, skipping %d tasks\n", task->name, skipped);
+                continue;
+            }
+            task->state = TASK_RUNNING;
+            startDeadline(&task->limit, &task->pid, 1, listGroup() == 0 ? task->pid : -1);
+            running[runningCount++] = next;
+        }
+        if(interrupted == true)
+        {
+            readyCount = 0;
+        }
+        if(runningCount == 0)
+        {
+            continue;
+        }
+
+        // A slot frees up with whichever task exits first
+        int childStatus;
+        struct rusage childUsage;
+        pid_t PID = waitEvent(-1, &childStatus, 0, &childUsage);
+        if(PID == -1)
+        {
+            break;
+        }
+        int slot = 0;
+        while(slot < runningCount && tasks[running[slot]].pid != PID)
+        {
+            slot ++;
+        }
+        // Background job of the shell
+        if(slot == runningCount)
+        {
+            collectProcess(PID, childStatus, &childUsage, true);
+            continue;
+        }
+        int finished = running[slot];
+        running[slot] = running[--runningCount];
+        struct task *task = &tasks[finished];
+        task->finish = secondsSince(&commandUsage.started);
+        task->pid = -1;
+        bool timedOut = stopDeadline(&task->limit);
+        addUsage(&commandUsage, &childUsage);
+        auditFinish(task->audit, childStatus);
+        task->audit = NULL;
+
+        if(timedOut == false && WIFEXITED(childStatus) == 1 && WEXITSTATUS(childStatus) == 0)
+        {
+            task->state = TASK_DONE;
+            for(int y = task->dependentStart; y < task->dependentStart + task->dependentCount; y++)
+            {
+                struct task *dependent = &tasks[dependentIndex[y]];
+                if(dependent->state == TASK_WAITING && --dependent->waiting == 0)
+                {
+                    dependent->state = TASK_READY;
+                    dependent->after = finished;
+                    ready[readyCount++] = dependentIndex[y];
+                }
+            }
+            continue;
+        }
+
+        task->state = TASK_FAILED;
+        failed ++;
+        int skipped = skipDependents(tasks, dependentIndex, finished);
+        if(timedOut == true)
+        {
+            printf("dag: %s timed out after %gs, status %d, skipping %d tasks\n", task->name, lineTimeout, TIMEOUT_STATUS, skipped);
+        }
+        else if(WIFEXITED(childStatus) != 1)
+        {
+            printf("dag: %s terminated by signal %d, skipping %d tasks\n", task->name, WTERMSIG(childStatus), skipped);
+            interrupted = interrupted == true || WTERMSIG(childStatus) == SIGINT;
+        }
+        else
+        {
+            printf("dag: %s exited with status %d, skipping %d tasks\n", task->name, WEXITSTATUS(childStatus), skipped);
+        }
+    }
+    if(valid == true)
+    {
+        dagSummary(tasks, count, secondsSince(&commandUsage.started));
+        foregroundUsage = commandUsage;
+        foregroundRuns ++;
+        // The status counts tasks, a timed out one is not the whole command
+        foregroundTimedOut = false;
+        *FGS = failed < 255 ? failed : 255;
+    }
+    fflush(stdout);
+
+    for(int x = 0; x < runningCount; x++)
+    {
+        stopDeadline(&tasks[running[x]].limit);
+        free(tasks[running[x]].audit);
+    }
+    close(nullFD);
+    arenaReset(&lineArena);
+    free(lineArena.block);
+    arenaReset(&taskArena);
+    free(taskArena.block);
+    free(running);
+    free(ready);
+    free(tasks);
+    free(needName);
+    free(needIndex);
+    free(dependentIndex);
+}
+
+bool runBuiltin(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       Runs a built in command in the shell itself, with the shell's own
+*       stdin and stdout. Entries main() handles (exit, parallel) do 
+*       nothing here.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Command structre
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       bool                            - false if not a built in
+****************************************************************************/
+{
+    const struct builtin *entry = findBuiltin(ourCommand->commandType);
+    if(entry == NULL)
+    {
+        return false;
+    }
+    if(entry->run != NULL)
+    {
+        entry->run(ourCommand, FGS);
+    }
+    return true;
+}
+
+// While output is captured stdout is a stream into the capture (see 
+// startCapture), shellStdout is the stream on descriptor 1 from before
+int captureDepth = 0;
+FILE *shellStdout = NULL;
+
+FILE *pointStdout(int targetFD, int *savedFD)
+/***************************************************************************
+*   Description -
+*       Points descriptor 1 at targetFD for a built in run inside the 
+*       shell, with stdout writing to it even while output is captured
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int targetFD                - File or pipe the built in writes to
+*       int *savedFD                - Set to a copy of descriptor 1
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      FILE *                       - stdout for restoreStdout()
+****************************************************************************/
+{
+    fflush(stdout);
+    FILE *lineStdout = stdout;
+    if(captureDepth > 0)
+    {
+        stdout = shellStdout;
+    }
+    *savedFD = dup(STDOUT_FILENO);
+    dup2(targetFD, STDOUT_FILENO);
+    return lineStdout;
+}
+
+void restoreStdout(FILE *lineStdout, int savedFD)
+/***************************************************************************
+*   Description -
+*       Undoes pointStdout()
+****************************************************************************/
+{
+    fflush(stdout);
+    dup2(savedFD, STDOUT_FILENO);
+    close(savedFD);
+    stdout = lineStdout;
+}
+
+bool builtinProcess(struct command *ourCommand, int* FGS)
+/***************************************************************************
+*   Description -
+*       Runs a command line's built in (see builtins[]). Native utilities 
+*       get their < and > files for the duration of the call, stdout is 
+*       pointed at the output file. A native utility asked to run in the
+*       background is left to otherProcess() like any external command.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Command structre
+*       int* FGS                        - Foreground exit status
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       bool                            - false if not run as a built in
+****************************************************************************/
+{
+    const struct builtin *entry = findBuiltin(ourCommand->commandType);
+    if(entry == NULL)
+    {
+        return false;
+    }
+    if(entry->native == false)
+    {
+        if(entry->run != NULL)
+        {
+            entry->run(ourCommand, FGS);
+        }
+        return true;
+    }
+    if(ourCommand->backGround == true && foregroundOnlymode == 0)
+    {
+        return false;
+    }
+
+    int sourceFD;
+    int targetFD;
+    if(openRedirections(ourCommand, &sourceFD, &targetFD) == false)
+    {
+        *FGS = 1;
+        return true;
+    }
+    // Nothing native reads stdin, the input file only has to open
+    if(sourceFD != -1)
+    {
+        close(sourceFD);
+    }
+    if(targetFD == -1)
+    {
+        entry->run(ourCommand, FGS);
+        return true;
+    }
+
+    int savedFD;
+    FILE *lineStdout = pointStdout(targetFD, &savedFD);
+    close(targetFD);
+    entry->run(ourCommand, FGS);
+    restoreStdout(lineStdout, savedFD);
+    return true;
+}
+
+void otherProcess(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*   Whenever a non-built in command is received, the parent (i.e., smallsh) 
+*   will spawn a child (see launchProcess).
+*   
+*   The child will use a function from the exec() family of functions to 
+*   run the command.
+*   
+*   Your shell should use the PATH variable to look for non-built in commands, 
+*   and it should allow shell scripts to be executed
+*   
+*   If a command fails because the shell could not find the command to run, 
+*   then the shell will print an error message and set the exit status to 1
+*   
+*   A child process must terminate after running a command 
+*   (whether the command is successful or it fails). 
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Command structre
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+{
+    // & is ignored while in foreground only mode
+    bool backGround = ourCommand->backGround == true && foregroundOnlymode == 0;
+
+    // file input and output, opened here so the spawn only needs dup2
+    int sourceFD;
+    int targetFD;
+    if(openRedirections(ourCommand, &sourceFD, &targetFD) == false)
+    {
+        *FGS = 1;
+        return;
+    }
+
+    // A background job's output goes through the shell when joboutput is on
+    int jobFD = -1;
+    struct jobOutput *output = backGround == true ? newJobOutput(&jobFD) : NULL;
+
+    struct usage commandUsage;
+    startUsage(&commandUsage);
+    // The record's start time covers the fork and exec
+    struct timespec started;
+    clock_gettime(CLOCK_REALTIME, &started);
+    pid_t spawnPid = launchProcess(ourCommand->argv, sourceFD, targetFD != -1 ? targetFD : jobFD, jobFD, backGround, timedGroup(backGround), SIGINT_action, SIGTSTP_action);
+
+    if(sourceFD != -1)
+    {
+        close(sourceFD);
+    }
+    if(targetFD != -1)
+    {
+        close(targetFD);
+    }
+    if(jobFD != -1)
+    {
+        close(jobFD);
+    }
+
+    // Child never started
+    if(spawnPid == -1)
+    {
+        attachJobOutput(output, 0);
+        *FGS = 1;
+        return;
+    }
+
+    char *record = auditHead(ourCommand, spawnPid, backGround, &started);
+
+    //Background process, continue as normal
+    if (backGround == true)
+    {
+        // Add background process to the job table
+        int job = addJob(&spawnPid, 1, describeCommand(ourCommand));
+        attachJobOutput(output, job);
+        if(record != NULL)
+        {
+            jobSlab[job - 1].audit = malloc(sizeof(char *));
+            jobSlab[job - 1].audit[0] = record;
+        }
+        printf("background pid is %d\n", spawnPid);
+        fflush(stdout);
+    }
+    // Foreground process, wait on execution
+    else
+    {
+        int childStatus;
+        struct rusage childUsage;
+        struct deadline limit;
+        startDeadline(&limit, &spawnPid, 1, timedGroup(false) == 0 ? spawnPid : -1);
+        waitEvent(spawnPid, &childStatus, 0, &childUsage);
+        spawnPid = -1;
+        auditFinish(record, childStatus);
+        addUsage(&commandUsage, &childUsage);
+        foregroundUsage = commandUsage;
+        foregroundRuns ++;
+        if(stopDeadline(&limit) == true)
+        {
+            printf("timed out after %gs (signal %d)\n", lineTimeout, WIFSIGNALED(childStatus) ? WTERMSIG(childStatus) : SIGTERM);
+            fflush(stdout);
+            *FGS = TIMEOUT_STATUS;
+            return;
+        }
+        if(WIFEXITED(childStatus) != 1)
+        {
+            printf("terminated by signal %d\n",  WTERMSIG(childStatus));
+            fflush(stdout);
+        }
+        *FGS = WEXITSTATUS(childStatus);
+    }
+}
+
+void pipelineProcess(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*   Runs a pipeline (command | command ...). Every external stage is 
+*   spawned up front so all stages run concurrently, connected with pipes.
+*   
+*   Built in stages run inside the shell once the external stages are up, 
+*   with stdout pointed at their pipe. Redirected files are dup2'd straight
+*   into the stage that uses them, so no pipeline data passes through the 
+*   shell.
+*   
+*   The exit status of the last stage becomes the foreground exit status.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - First stage of the pipeline
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*       None
+****************************************************************************/
+{
+    // & is ignored while in foreground only mode
+    bool backGround = ourCommand->backGround == true && foregroundOnlymode == 0;
+
+    int stages = 0;
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next)
+    {
+        stages ++;
+    }
+
+    // Per stage stdin/stdout, -1 leaves the shell's own descriptor
+    int sourceFD[stages];
+    int targetFD[stages];
+    pid_t stagePid[stages];
+    char *stageAudit[stages];
+    bool stageOpened[stages];
+    struct usage commandUsage;
+    startUsage(&commandUsage);
+    int x = 0;
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next, x++)
+    {
+        stagePid[x] = -1;
+        stageAudit[x] = NULL;
+        stageOpened[x] = openRedirections(stage, &sourceFD[x], &targetFD[x]);
+    }
+
+    // Connect each stage to the next, explicit redirections win over pipes
+    for(x = 0; x < stages - 1; x++)
+    {
+        int pipeFD[2];
+        if(pipe2(pipeFD, O_CLOEXEC) == -1)
+        {
+            perror("pipe()");
+            fflush(stdout);
+            pipeFD[0] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            pipeFD[1] = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        }
+        if(targetFD[x] == -1)
+        {
+            targetFD[x] = pipeFD[1];
+        }
+        else
+        {
+            close(pipeFD[1]);
+        }
+        if(sourceFD[x+1] == -1)
+        {
+            sourceFD[x+1] = pipeFD[0];
+        }
+        else
+        {
+            close(pipeFD[0]);
+        }
+    }
+
+    // A background pipeline's output, stderr from every stage and stdout 
+    // from the last, goes through the shell when joboutput is on. Built 
+    // ins still write straight to the terminal
+    int jobFD = -1;
+    struct jobOutput *output = backGround == true ? newJobOutput(&jobFD) : NULL;
+    struct command *lastStage = ourCommand;
+    while(lastStage->next != NULL)
+    {
+        lastStage = lastStage->next;
+    }
+    if(jobFD != -1 && targetFD[stages - 1] == -1 && isBuiltin(lastStage->commandType) == false)
+    {
+        targetFD[stages - 1] = fcntl(jobFD, F_DUPFD_CLOEXEC, 0);
+    }
+
+    // Start every external stage before any built in produces output.
+    // A background or timed pipeline is one process group, foreground 
+    // stays in ours
+    pid_t group = timedGroup(backGround);
+    x = 0;
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next, x++)
+    {
+        if(stageOpened[x] == false || isBuiltin(stage->commandType) == true)
+        {
+            continue;
+        }
+        struct timespec started;
+        clock_gettime(CLOCK_REALTIME, &started);
+        stagePid[x] = launchProcess(stage->argv, sourceFD[x], targetFD[x], jobFD, backGround, group, SIGINT_action, SIGTSTP_action);
+        if(stagePid[x] != -1)
+        {
+            stageAudit[x] = auditHead(stage, stagePid[x], backGround, &started);
+        }
+        // The first stage started leads the job's process group
+        if(group == 0 && stagePid[x] != -1)
+        {
+            group = stagePid[x];
+        }
+        if(sourceFD[x] != -1)
+        {
+            close(sourceFD[x]);
+            sourceFD[x] = -1;
+        }
+        if(targetFD[x] != -1)
+        {
+            close(targetFD[x]);
+            targetFD[x] = -1;
+        }
+    }
+    if(jobFD != -1)
+    {
+        close(jobFD);
+    }
+
+    // Built in stages write into their pipe from the shell. SIGPIPE is 
+    // ignored meanwhile so a reader that already exited can't kill us
+    x = 0;
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next, x++)
+    {
+        // Built ins don't read stdin, and a stage that did not start reads
+        // nothing either. Closing its end first makes output larger than 
+        // the pipe fail instead of blocking the shell
+        if(x + 1 < stages && stagePid[x+1] == -1 && sourceFD[x+1] != -1)
+        {
+            close(sourceFD[x+1]);
+            sourceFD[x+1] = -1;
+        }
+        if(stageOpened[x] == true && stagePid[x] == -1 && targetFD[x] != -1)
+        {
+            int savedFD;
+            FILE *lineStdout = pointStdout(targetFD[x], &savedFD);
+            signal(SIGPIPE, SIG_IGN);
+            runBuiltin(stage, FGS);
+            fflush(stdout);
+            signal(SIGPIPE, SIG_DFL);
+            restoreStdout(lineStdout, savedFD);
+        }
+        else if(stageOpened[x] == true && stagePid[x] == -1)
+        {
+            runBuiltin(stage, FGS);
+        }
+        if(sourceFD[x] != -1)
+        {
+            close(sourceFD[x]);
+        }
+        if(targetFD[x] != -1)
+        {
+            close(targetFD[x]);
+        }
+    }
+
+    int last = stages - 1;
+    struct command *stageCommand = ourCommand;
+    while(stageCommand->next != NULL)
+    {
+        stageCommand = stageCommand->next;
+    }
+    if (backGround == true)
+    {
+        // One job for every started stage, report the last one like a
+        // single command
+        pid_t jobPids[stages];
+        char **jobAudit = audit.fd != -1 ? malloc(stages * sizeof(char *)) : NULL;
+        int count = 0;
+        for(x = 0; x < stages; x++)
+        {
+            if(stagePid[x] != -1)
+            {
+                if(jobAudit != NULL)
+                {
+                    jobAudit[count] = stageAudit[x];
+                }
+                jobPids[count++] = stagePid[x];
+            }
+        }
+        if(count > 0)
+        {
+            int job = addJob(jobPids, count, describeCommand(ourCommand));
+            jobSlab[job - 1].audit = jobAudit;
+            attachJobOutput(output, job);
+        }
+        else
+        {
+            free(jobAudit);
+            attachJobOutput(output, 0);
+        }
+        if(stagePid[last] != -1)
+        {
+            printf("background pid is %d\n", stagePid[last]);
+            fflush(stdout);
+        }
+        return;
+    }
+
+    // Foreground, wait for every stage and keep the status of the last
+    int lastStatus = 0;
+    if(stageOpened[last] == false || (stagePid[last] == -1 && isBuiltin(stageCommand->commandType) == false))
+    {
+        lastStatus = 1;
+    }
+    else if(stagePid[last] == -1 && findBuiltin(stageCommand->commandType)->native == true)
+    {
+        lastStatus = *FGS;
+    }
+    struct deadline limit;
+    startDeadline(&limit, stagePid, stages, group > 0 ? group : -1);
+    int lastSignal = 0;
+    for(x = 0; x < stages; x++)
+    {
+        if(stagePid[x] == -1)
+        {
+            continue;
+        }
+        int childStatus;
+        struct rusage childUsage;
+        waitEvent(stagePid[x], &childStatus, 0, &childUsage);
+        stagePid[x] = -1;
+        auditFinish(stageAudit[x], childStatus);
+        addUsage(&commandUsage, &childUsage);
+        if(x == last)
+        {
+            lastSignal = WIFEXITED(childStatus) != 1 ? WTERMSIG(childStatus) : 0;
+            lastStatus = WEXITSTATUS(childStatus);
+        }
+    }
+    foregroundUsage = commandUsage;
+    foregroundRuns ++;
+    if(stopDeadline(&limit) == true)
+    {
+        printf("timed out after %gs (signal %d)\n", lineTimeout, lastSignal != 0 ? lastSignal : SIGTERM);
+        lastStatus = TIMEOUT_STATUS;
+    }
+    else if(lastSignal != 0)
+    {
+        printf("terminated by signal %d\n", lastSignal);
+    }
+    fflush(stdout);
+    *FGS = lastStatus;
+}
+
+
+void runLine(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Executes a parsed line depending on its type: blank, pipeline, 
+*       built in (see builtins[]) or external command. exit is left to 
+*       main(), here it does nothing.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Line to run
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct timespec started;
+    bool audited = audit.fd != -1;
+    if(audited == true)
+    {
+        clock_gettime(CLOCK_REALTIME, &started);
+    }
+
+    if(strcmp(ourCommand->commandType,"Blank") == 0)
+    {}
+    // Pipeline
+    else if (ourCommand->next != NULL)
+    {
+        pipelineProcess(ourCommand, FGS, SIGINT_action, SIGTSTP_action);
+    }
+    // Built ins that launch commands
+    else if (strcmp(ourCommand->commandType,"parallel") == 0)
+    {
+        parallelProcess(ourCommand, FGS, SIGINT_action, SIGTSTP_action);
+    }
+    else if (strcmp(ourCommand->commandType,"dag") == 0)
+    {
+        dagProcess(ourCommand, FGS, SIGINT_action, SIGTSTP_action);
+    }
+    // Built in (see builtins[]), audited with pid 0
+    else if (builtinProcess(ourCommand, FGS) == true)
+    {
+        if(audited == true)
+        {
+            auditFinish(auditHead(ourCommand, 0, false, &started), W_EXITCODE(*FGS & 255, 0));
+        }
+    }
+    // All other cases
+    else
+    {
+        otherProcess(ourCommand, FGS, SIGINT_action, SIGTSTP_action);
+    }
+}
+
+struct capture
+/**************************************************************************
+*   Description -
+*       Output of a $(command), read from its pipe as it is written
+*   -----------------------------------------------------------------------
+*    char *data             - Bytes read so far, malloc'd
+*    size_t length          - Bytes in data
+*    size_t capacity        - Size of data
+*    FILE *saved            - stdout from before the capture
+*
+***************************************************************************/
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    FILE *saved;
+};
+
+// Capture pipes are grown to this so most output never fills them
+#define CAPTURE_PIPE_SIZE (1 << 20)
+#define CAPTURE_CHUNK 65536
+
+void readCapture(struct eventSource *source, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Ready handler of a capture pipe, reads everything available in 
+*       CAPTURE_CHUNK or larger reads. The pipe's read end is non-blocking.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Pipe, data is the struct capture
+*       uint32_t events             - Unused
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct capture *output = source->data;
+    while(true)
+    {
+        if(output->capacity - output->length < CAPTURE_CHUNK)
+        {
+            output->capacity = output->capacity == 0 ? CAPTURE_CHUNK : output->capacity * 2;
+            output->data = realloc(output->data, output->capacity);
+        }
+        ssize_t count = read(source->fd, output->data + output->length, output->capacity - output->length);
+        if(count <= 0)
+        {
+            return;
+        }
+        output->length += count;
+    }
+}
+
+ssize_t writeCapture(void *cookie, const char *data, size_t size)
+/***************************************************************************
+*   Description -
+*       Write function of the stdout stream built ins print to while 
+*       output is captured. Takes what commands have put in the pipe so
+*       far first, to keep the order, then appends data itself, so the 
+*       shell never writes to a pipe only it reads.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       void *cookie                - Capture pipe's event source
+*       const char *data            - Bytes printed
+*       size_t size                 - Length of data
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      ssize_t                      - size, all of it is taken
+****************************************************************************/
+{
+    struct eventSource *source = cookie;
+    struct capture *output = source->data;
+    readCapture(source, EPOLLIN);
+    if(output->capacity - output->length < size)
+    {
+        output->capacity = output->length + size + CAPTURE_CHUNK;
+        output->data = realloc(output->data, output->capacity);
+    }
+    memcpy(output->data + output->length, data, size);
+    output->length += size;
+    return size;
+}
+
+int startCapture(struct eventSource *source, struct capture *output)
+/***************************************************************************
+*   Description -
+*       Points the shell's stdout at a pipe, so external commands are 
+*       launched on it exactly as usual. The read end is an event source,
+*       drained while foreground waits run the event loop, so output of 
+*       any size never blocks a command. Built ins run in the shell, which
+*       can't wait on a pipe it reads itself, so stdout becomes a stream 
+*       that appends to the capture directly (see writeCapture).
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Set up as the pipe's read end
+*       struct capture *output      - Receives the output
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                          - Saved stdout for endCapture(), -1 
+*                                     if there is no pipe
+****************************************************************************/
+{
+    int capturePipe[2];
+    if(pipe2(capturePipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe()");
+        return -1;
+    }
+    fcntl(capturePipe[1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+    // Only our end is non-blocking, the commands write as usual
+    fcntl(capturePipe[0], F_SETFL, O_NONBLOCK);
+    source->fd = capturePipe[0];
+    source->ready = readCapture;
+    source->data = output;
+    watchEvents(source, EPOLLIN);
+
+    fflush(stdout);
+    int savedFD = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(capturePipe[1], STDOUT_FILENO);
+    close(capturePipe[1]);
+
+    cookie_io_functions_t functions = {NULL, writeCapture, NULL, NULL};
+    if(captureDepth++ == 0)
+    {
+        shellStdout = stdout;
+    }
+    output->saved = stdout;
+    FILE *stream = fopencookie(source, "w", functions);
+    if(stream != NULL)
+    {
+        stdout = stream;
+    }
+    return savedFD;
+}
+
+void endCapture(struct eventSource *source, int savedFD)
+/***************************************************************************
+*   Description -
+*       Restores stdout and reads what is left in the pipe. A background
+*       process still holding the pipe is not waited for.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Pipe from startCapture()
+*       int savedFD                 - Returned by startCapture()
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct capture *output = source->data;
+    dup2(savedFD, STDOUT_FILENO);
+    close(savedFD);
+    if(stdout != output->saved)
+    {
+        fclose(stdout);
+        stdout = output->saved;
+    }
+    captureDepth --;
+
+    readCapture(source, EPOLLIN);
+    unwatchEvents(source);
+    close(source->fd);
+}
+
+void captureOutput(struct command *inner, struct capture *output, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Runs a line in the foreground with its output captured (see
+*       startCapture())
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *inner           - Line to run, already substituted
+*       struct capture *output          - Receives the output
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct eventSource source;
+    int savedFD = startCapture(&source, output);
+    if(savedFD == -1)
+    {
+        return;
+    }
+
+    // Runs in the foreground, and exit only leaves the substitution
+    inner->backGround = false;
+    int innerStatus = 0;
+    if(strcmp(inner->commandType, "exit") != 0)
+    {
+        runLine(inner, &innerStatus, SIGINT_action, SIGTSTP_action);
+    }
+
+    endCapture(&source, savedFD);
+}
+
+struct command *substituteCommand(struct command *ourCommand, struct arena *lineArena, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Command substitution. Every $(command) in a word is run with its
+*       output captured (see captureOutput), trailing newlines removed,
+*       and put in its place. In arguements the output is split into 
+*       words at spaces, tabs and newlines, text around it joins the 
+*       first and last word. In < and > files it is not split. The inner
+*       command is parsed like a line of its own, so $$ and nested $(...)
+*       work inside it.
+*
+*       The parsed line may be shared with the line cache, so the result 
+*       is a new command in lineArena and ourCommand is left as is.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Parsed line with substitute set
+*       struct arena *lineArena         - Per line arena
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct command *                 - Line to run
+****************************************************************************/
+{
+    struct command *first = NULL;
+    struct command **link = &first;
+    char **fields = NULL;
+    struct capture word = {NULL, 0, 0};
+    for(struct command *stage = ourCommand; stage != NULL; stage = stage->next)
+    {
+        struct command *copy = arenaAlloc(lineArena, sizeof(struct command));
+        *copy = *stage;
+        copy->substitute = false;
+        copy->next = NULL;
+        *link = copy;
+        link = &copy->next;
+
+        // The stage's words, then its < and > files
+        int count = 0;
+        int words = 0;
+        while(stage->argv[words] != NULL)
+        {
+            words ++;
+        }
+        char **file[2] = {&copy->inputFile, &copy->outputFile};
+        for(int x = 0; x < words + 2; x++)
+        {
+            const char *text = x < words ? stage->argv[x] : *file[x - words];
+            bool split = x < words;
+            if(text == NULL || strstr(text, "$(") == NULL)
+            {
+                if(split == true)
+                {
+                    addField(&fields, &count, text, strlen(text), lineArena);
+                }
+                continue;
+            }
+
+            // word holds the field being built, open that it has started
+            word.length = 0;
+            bool open = false;
+            const char *scan = text;
+            while(*scan != '\0')
+            {
+                // Literal text up to the next complete $(...)
+                const char *start = strstr(scan, "$(");
+                const char *close = start != NULL ? start + 2 : NULL;
+                for(int depth = 1; close != NULL && *close != '\0'; close++)
+                {
+                    depth += (*close == '(') - (*close == ')');
+                    if(depth == 0)
+                    {
+                        break;
+                    }
+                }
+                size_t literal = close != NULL && *close == ')' ? (size_t)(start - scan) : strlen(scan);
+                if(word.capacity - word.length < literal + 1)
+                {
+                    word.capacity = word.length + literal + CAPTURE_CHUNK;
+                    word.data = realloc(word.data, word.capacity);
+                }
+                memcpy(word.data + word.length, scan, literal);
+                word.length += literal;
+                open = open || literal > 0;
+                scan += literal;
+                if(*scan == '\0')
+                {
+                    break;
+                }
+
+                // Run the inner command, its output lands after the text
+                struct command *inner = parseBuffer(start + 2, close - start - 2, lineArena);
+                if(inner->substitute == true)
+                {
+                    inner = substituteCommand(inner, lineArena, SIGINT_action, SIGTSTP_action);
+                }
+                if(inner->glob == true)
+                {
+                    inner = globCommand(inner, lineArena);
+                }
+                size_t before = word.length;
+                if(inner != NULL)
+                {
+                    captureOutput(inner, &word, SIGINT_action, SIGTSTP_action);
+                }
+                while(word.length > before && word.data[word.length - 1] == '\n')
+                {
+                    word.length --;
+                }
+                scan = close + 1;
+                if(split == false)
+                {
+                    continue;
+                }
+
+                // Every finished field is added, the last stays in word
+                size_t fieldStart = 0;
+                for(size_t y = before; y < word.length; y++)
+                {
+                    char byte = word.data[y];
+                    if(byte != ' ' && byte != '\t' && byte != '\n')
+                    {
+                        open = true;
+                    }
+                    else
+                    {
+                        if(open == true)
+                        {
+                            addField(&fields, &count, word.data + fieldStart, y - fieldStart, lineArena);
+                            open = false;
+                        }
+                        fieldStart = y + 1;
+                    }
+                }
+                memmove(word.data, word.data + fieldStart, word.length - fieldStart);
+                word.length -= fieldStart;
+            }
+
+            if(split == true && open == true)
+            {
+                addField(&fields, &count, word.data, word.length, lineArena);
+            }
+            else if(split == false)
+            {
+                *file[x - words] = arenaAlloc(lineArena, word.length + 1);
+                memcpy(*file[x - words], word.data, word.length);
+                (*file[x - words])[word.length] = '\0';
+            }
+        }
+
+        copy->argv = arenaAlloc(lineArena, (count + 1) * sizeof(char *));
+        if(count > 0)
+        {
+            memcpy(copy->argv, fields, count * sizeof(char *));
+        }
+        copy->argv[count] = NULL;
+        copy->arguements = count > 0 ? copy->argv + 1 : copy->argv;
+        // Nothing left of the command means nothing to run
+        copy->commandType = count > 0 ? copy->argv[0] : "Blank";
+    }
+    free(fields);
+    free(word.data);
+
+    // Patterns in the output are expanded too
+    first->glob = true;
+    return first;
+}
+
+struct command *expandCommand(struct command *ourCommand, struct arena *lineArena, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Expands a parsed line before it runs: $(command) first, then 
+*       patterns (globCommand)
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Parsed line
+*       struct arena *lineArena         - Per line arena
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct command *                 - Line to run, NULL (reported) if
+*                                         it cannot run
+****************************************************************************/
+{
+    if(ourCommand->substitute == true)
+    {
+        ourCommand = substituteCommand(ourCommand, lineArena, SIGINT_action, SIGTSTP_action);
+    }
+    if(ourCommand->glob == true)
+    {
+        ourCommand = globCommand(ourCommand, lineArena);
+    }
+    return ourCommand;
+}
+
+bool executeLine(struct command *ourCommand, int* FGS, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Runs a parsed (and substituted) line with its time, timeout and 
+*       cpus prefixes applied. main() runs every line read this way, the
+*       server every line a client sends.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct command *ourCommand      - Line to run
+*       int* FGS                        - Foreground exit status
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                             - false if the line is exit
+****************************************************************************/
+{
+    struct usage timer;
+    struct command timedCommand;
+    struct command limitedCommand;
+    struct command policyCommand;
+    int timedRuns = -1;
+    bool limited = false;
+    bool placed = false;
+    lineTimeout = defaultTimeout;
+    lineGrace = defaultGrace;
+    currentPolicy = &defaultPolicy;
+
+    // Prefixes come in any order, each at most once. A repeated one is
+    // left for the rest of the line
+    bool prefixed = true;
+    while(prefixed == true)
+    {
+        prefixed = false;
+        // time prefix, the rest of the line runs as if typed alone
+        if(timedRuns == -1 && strcmp(ourCommand->commandType,"time") == 0)
+        {
+            timedCommand = *ourCommand;
+            ourCommand = &timedCommand;
+            timedRuns = foregroundRuns;
+            timeStart(ourCommand, &timer);
+            prefixed = true;
+        }
+        // timeout prefix, the rest of the line runs under its own limit.
+        // Without it the shell wide limit (timeout -d) applies
+        else if(limited == false && strcmp(ourCommand->commandType,"timeout") == 0)
+        {
+            limitedCommand = *ourCommand;
+            if(timeoutPrefix(&limitedCommand) == true)
+            {
+                ourCommand = &limitedCommand;
+                limited = true;
+                prefixed = true;
+            }
+        }
+        // cpus prefix, the rest of the line launches under its own policy
+        else if(placed == false && strcmp(ourCommand->commandType,"cpus") == 0)
+        {
+            policyCommand = *ourCommand;
+            ourCommand = &policyCommand;
+            policyPrefix(ourCommand);
+            placed = true;
+            prefixed = true;
+        }
+    }
+
+    // exit is left to the caller
+    if (ourCommand->next == NULL && strcmp(ourCommand->commandType,"exit") == 0)
+    {
+        return false;
+    }
+    runLine(ourCommand, FGS, SIGINT_action, SIGTSTP_action);
+
+    if(timedRuns != -1)
+    {
+        timeReport(&timer, timedRuns);
+    }
+    return true;
+}
+
+// Server mode (smallsh --serve PATH). Clients send lines over a Unix socket
+// and get a status line back for each, see serveClients()
+#define CLIENT_BACKLOG (1 << 20)    // Unsent reply bytes before a client waits
+
+struct client
+/**************************************************************************
+*   Description -
+*       A connection to the server. Lines are read into input as they
+*       arrive and run one at a time by serveClients(), replies wait in
+*       output until the socket takes them.
+*   -----------------------------------------------------------------------
+*    struct eventSource source  - Socket, data is the client
+*    struct lineReader input    - Lines received and not run yet
+*    struct capture output      - Replies, sent from sent on
+*    size_t sent                - Bytes of output already sent
+*    uint32_t events            - Events watched on the socket
+*    int status                 - Foreground exit status of its lines
+*    bool capture               - Output of its lines is sent back
+*    bool hungUp                - Socket closed by the client
+*    bool finished              - No more lines will run, closed once 
+*                                 output is sent
+*    struct client *next        - Next connection
+*
+***************************************************************************/
+{
+    struct eventSource source;
+    struct lineReader input;
+    struct capture output;
+    size_t sent;
+    uint32_t events;
+    int status;
+    bool capture;
+    bool hungUp;
+    bool finished;
+    struct client *next;
+};
+struct client *clients = NULL;
+
+void clientEvents(struct client *client)
+/***************************************************************************
+*   Description -
+*       Watches a client's socket for what it needs: more input until a 
+*       whole line is buffered, and room for output while replies wait.
+*       Reading stops while a line waits, which holds a fast client back.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct client *client       - Client to update
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(client->hungUp == true)
+    {
+        return;
+    }
+    uint32_t events = 0;
+    if(client->finished == false && lineBuffered(&client->input) == false)
+    {
+        events |= EPOLLIN;
+    }
+    if(client->sent < client->output.length)
+    {
+        events |= EPOLLOUT;
+    }
+    if(events != client->events)
+    {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = &client->source;
+        epoll_ctl(eventFD, EPOLL_CTL_MOD, client->source.fd, &event);
+        client->events = events;
+    }
+}
+
+void sendClient(struct client *client)
+/***************************************************************************
+*   Description -
+*       Sends as much waiting output as the socket takes. A client that
+*       can no longer be written to loses its output and is finished.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct client *client       - Client to send to
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    while(client->sent < client->output.length)
+    {
+        ssize_t count = send(client->source.fd, client->output.data + client->sent,
+                             client->output.length - client->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if(count > 0)
+        {
+            client->sent += count;
+        }
+        else if(count == -1 && errno == EINTR)
+        {}
+        else if(count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            client->finished = true;
+            client->sent = client->output.length;
+        }
+    }
+    if(client->sent == client->output.length)
+    {
+        client->sent = 0;
+        client->output.length = 0;
+    }
+    clientEvents(client);
+}
+
+void replyClient(struct client *client, const char *data, size_t length)
+/***************************************************************************
+*   Description -
+*       Queues bytes for a client and sends what the socket takes now.
+*       Replies to a client that hung up are dropped.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct client *client       - Client to reply to
+*       const char *data            - Bytes to send
+*       size_t length               - Number of bytes
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(client->hungUp == true)
+    {
+        return;
+    }
+    struct capture *output = &client->output;
+    if(output->capacity - output->length < length)
+    {
+        while(output->capacity - output->length < length)
+        {
+            output->capacity = output->capacity == 0 ? CAPTURE_CHUNK : output->capacity * 2;
+        }
+        output->data = realloc(output->data, output->capacity);
+    }
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    sendClient(client);
+}
+
+void receiveClient(struct lineReader *reader)
+/***************************************************************************
+*   Description -
+*       One non-blocking read into a client's reader, behind the bytes
+*       not handed out yet. readLine() is only called once lineBuffered()
+*       says it will not read itself.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct lineReader *reader   - Reader of a client socket
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(reader->start > 0)
+    {
+        memmove(reader->data, reader->data + reader->start, reader->filled - reader->start);
+        reader->filled -= reader->start;
+        reader->start = 0;
+    }
+    if(reader->filled == reader->capacity)
+    {
+        reader->capacity *= 2;
+        reader->data = realloc(reader->data, reader->capacity);
+    }
+    ssize_t count = read(reader->fd, reader->data + reader->filled, reader->capacity - reader->filled);
+    if(count > 0)
+    {
+        reader->filled += count;
+    }
+    else if(count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        reader->eof = true;
+    }
+}
+
+void clientReady(struct eventSource *source, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Ready handler of a client socket. Only moves bytes, lines are run
+*       by serveClients() so they never nest inside another line's wait.
+*       Once the client hangs up, what it sent is still run but nothing 
+*       more is watched.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Socket, data is the client
+*       uint32_t events             - Events from epoll
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    struct client *client = source->data;
+    if((events & (EPOLLHUP | EPOLLERR)) != 0)
+    {
+        while(client->input.eof == false)
+        {
+            receiveClient(&client->input);
+        }
+        unwatchEvents(source);
+        client->hungUp = true;
+        client->sent = client->output.length = 0;
+        return;
+    }
+    if((events & EPOLLIN) != 0)
+    {
+        receiveClient(&client->input);
+    }
+    if((events & EPOLLOUT) != 0)
+    {
+        sendClient(client);
+    }
+    clientEvents(client);
+}
+
+void acceptClients(struct eventSource *source, uint32_t events)
+/***************************************************************************
+*   Description -
+*       Ready handler of the listening socket, takes every pending 
+*       connection. New clients go to the end of clients.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct eventSource *source  - Listening socket
+*       uint32_t events             - Unused
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    int fd;
+    while((fd = accept4(source->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        struct client *client = calloc(1, sizeof(struct client));
+        client->source.fd = fd;
+        client->source.ready = clientReady;
+        client->source.data = client;
+        openReader(&client->input, fd);
+        client->events = EPOLLIN;
+        watchEvents(&client->source, EPOLLIN);
+
+        struct client **last = &clients;
+        while(*last != NULL)
+        {
+            last = &(*last)->next;
+        }
+        *last = client;
     }
+}
+struct eventSource listenSource = {-1, acceptClients, NULL};
 
-    // Due to server crashes, program reattempts fork
-    int attempts = 0;
-    int childStatus;
-    fflush(stdin);
+void closeClient(struct client *client)
+/***************************************************************************
+*   Description -
+*       Removes a client from clients, closes its socket and frees it
+****************************************************************************/
+{
+    struct client **link = &clients;
+    while(*link != client)
+    {
+        link = &(*link)->next;
+    }
+    *link = client->next;
+    if(client->hungUp == false)
+    {
+        unwatchEvents(&client->source);
+    }
+    closeReader(&client->input);
+    free(client->output.data);
+    free(client);
+}
 
-    // Fork off to child process
-    pid_t spawnPid = fork();
+bool openServer(const char *path)
+/***************************************************************************
+*   Description -
+*       Listens on a Unix socket at path, readable by its owner only. A 
+*       socket left at path by a server that is gone is replaced, one 
+*       that still accepts connections is not.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *path            - Socket path
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                         - false (reported) if it cannot listen
+****************************************************************************/
+{
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
 
-    // Due to server crashes, program reattempts fork
-    while(spawnPid == -1 && attempts < 45)
+    listenSource.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenSource.fd == -1)
+    {
+        perror("socket()");
+        return false;
+    }
+    mode_t mask = umask(077);
+    int result = bind(listenSource.fd, (struct sockaddr *)&address, sizeof(address));
+    if(result == -1 && errno == EADDRINUSE)
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(connect(probe, (struct sockaddr *)&address, sizeof(address)) == -1 && errno == ECONNREFUSED)
+        {
+            unlink(path);
+            result = bind(listenSource.fd, (struct sockaddr *)&address, sizeof(address));
+        }
+        else
+        {
+            errno = EADDRINUSE;
+        }
+        close(probe);
+    }
+    umask(mask);
+    if(result == -1 || listen(listenSource.fd, SOMAXCONN) == -1 || watchEvents(&listenSource, EPOLLIN) == false)
+    {
+        perror(path);
+        close(listenSource.fd);
+        listenSource.fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void serveLine(struct client *client, struct arena *lineArena, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Runs a client's next line and replies. Lines are run as if typed
+*       at the shell, with the client's own exit status. Replies:
+*           status N            - After every line
+*           output LENGTH       - Before status while capture is on, 
+*                                 followed by LENGTH bytes of stdout
+*       Lines starting with % are for the server:
+*           %capture on|off     - Send back the output of each line
+*       exit ends the connection, the server keeps running.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct client *client           - Client with a line buffered
+*       struct arena *lineArena         - Line arena, reset by the caller
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    const char *buffer;
+    size_t size;
+    if(readLine(&client->input, &buffer, &size) == false)
+    {
+        client->finished = true;
+        clientEvents(client);
+        return;
+    }
+    // Read the next line while this one runs
+    clientEvents(client);
+
+    char reply[64];
+    if(size > 0 && buffer[0] == '%')
+    {
+        if(size == 11 && memcmp(buffer, "%capture on", 11) == 0)
+        {
+            client->capture = true;
+            client->status = 0;
+        }
+        else if(size == 12 && memcmp(buffer, "%capture off", 12) == 0)
+        {
+            client->capture = false;
+            client->status = 0;
+        }
+        else
+        {
+            client->status = 2;
+        }
+        replyClient(client, reply, snprintf(reply, sizeof(reply), "status %d\n", client->status));
+        return;
+    }
+
+    struct command *ourCommand = expandCommand(cachedParse(buffer, size, lineArena), lineArena, SIGINT_action, SIGTSTP_action);
+    if(ourCommand == NULL)
+    {
+        client->status = 1;
+        replyClient(client, reply, snprintf(reply, sizeof(reply), "status %d\n", client->status));
+        return;
+    }
+
+    // Background jobs keep the server's stdout, the pipe is gone when
+    // they write. Built ins print into output directly (see 
+    // writeCapture), so no line blocks the server on its own pipe
+    struct capture output = {0};
+    struct eventSource source;
+    int savedFD = -1;
+    if(client->capture == true && (ourCommand->backGround == false || foregroundOnlymode != 0))
+    {
+        savedFD = startCapture(&source, &output);
+    }
+    bool more = executeLine(ourCommand, &client->status, SIGINT_action, SIGTSTP_action);
+    if(savedFD != -1)
+    {
+        endCapture(&source, savedFD);
+        replyClient(client, reply, snprintf(reply, sizeof(reply), "output %zu\n", output.length));
+        replyClient(client, output.data, output.length);
+        free(output.data);
+    }
+    fflush(stdout);
+
+    if(more == false)
+    {
+        client->finished = true;
+        clientEvents(client);
+        return;
+    }
+    replyClient(client, reply, snprintf(reply, sizeof(reply), "status %d\n", client->status));
+}
+
+struct client *nextClient(struct client *from)
+/***************************************************************************
+*   Description -
+*       Finds the next client with a line to run, starting at from and 
+*       going round once, so every connection gets a turn. A client whose
+*       replies are backed up (CLIENT_BACKLOG) waits for them to be read.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       struct client *from         - First client to look at, NULL for 
+*                                     the start of clients
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      struct client*               - Client to serve, NULL if none
+****************************************************************************/
+{
+    struct client *start = from != NULL ? from : clients;
+    struct client *client = start;
+    while(client != NULL)
+    {
+        if(client->finished == false && lineBuffered(&client->input) == true &&
+           client->output.length - client->sent < CLIENT_BACKLOG)
+        {
+            return client;
+        }
+        client = client->next != NULL ? client->next : clients;
+        if(client == start)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int serveClients(const char *path, struct sigaction SIGINT_action, struct sigaction SIGTSTP_action)
+/***************************************************************************
+*   Description -
+*       Server mode, smallsh --serve PATH. One long lived shell accepts
+*       any number of connections on a Unix socket and keeps its PATH and
+*       parse caches across all of them. Sockets are served by the event
+*       loop; lines run one at a time, a line from each client in turn,
+*       and share the shell (directory, variables, jobs). Runs until 
+*       SIGINT or SIGTERM, then ends its jobs like exit.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       const char *path                - Socket path
+*       struct sigaction SIGINT_action  - SIGINT handler
+*       struct sigaction SIGTSTP_action - SIGTSTP handler
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                              - Exit status of the shell
+****************************************************************************/
+{
+    // SIGTERM is read from the signalfd too, to stop cleanly
+    sigaddset(&shellSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &shellSignals, NULL);
+    signalfd(signalSource.fd, &shellSignals, 0);
+    if(openServer(path) == false)
+    {
+        return 1;
+    }
+    serving = true;
+
+    struct arena lineArena = {0};
+    struct client *turn = NULL;
+    while(stopServing == false)
+    {
+        arenaReset(&lineArena);
+        reapProcesses(false);
+
+        // Connections that are done and have been sent everything
+        struct client *client = clients;
+        while(client != NULL)
+        {
+            struct client *next = client->next;
+            if(client->finished == true && client->sent == client->output.length)
+            {
+                if(turn == client)
+                {
+                    turn = next;
+                }
+                closeClient(client);
+            }
+            client = next;
+        }
+
+        client = nextClient(turn);
+        if(client == NULL)
+        {
+            fflush(stdout);
+            auditFlush();
+            runEvents(-1);
+            continue;
+        }
+        turn = client->next;
+        serveLine(client, &lineArena, SIGINT_action, SIGTSTP_action);
+    }
+
+    while(clients != NULL)
+    {
+        closeClient(clients);
+    }
+    unwatchEvents(&listenSource);
+    close(listenSource.fd);
+    unlink(path);
+    exitProcess();
+    free(lineArena.block);
+    return 0;
+}
+
+struct trieNode
+/**************************************************************************
+*   Description -
+*       Node of the command name trie used for completion. Node 0 is the
+*       root. The children of a node form a list through sibling, kept in
+*       byte order so names come out sorted.
+*   -----------------------------------------------------------------------
+*    int child              - First child, -1 if none
+*    int sibling            - Next child of the same parent, -1 ends it
+*    char byte              - Byte leading to this node
+*    bool terminal          - A command name ends here
+*
+***************************************************************************/
+{
+    int child;
+    int sibling;
+    char byte;
+    bool terminal;
+};
+
+// Trie of built ins and $PATH executables, rebuilt when a directory changes
+struct trieNode *commandTrie = NULL;
+int trieCount = 0;
+int trieCapacity = 0;
+char *triePath = NULL;          // $PATH the trie was built from
+unsigned long trieBuilt = 0;    // listingReads when it was built
+
+int trieChild(int node, char byte, bool create)
+/***************************************************************************
+*   Description -
+*       Finds (or adds) the child of a trie node for a byte
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int node                - Parent node
+*       char byte               - Byte of the child
+*       bool create             - Add the child if it is missing
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      int                      - Child node, -1 if missing
+****************************************************************************/
+{
+    int previous = -1;
+    int next = commandTrie[node].child;
+    while(next != -1 && (unsigned char)commandTrie[next].byte < (unsigned char)byte)
+    {
+        previous = next;
+        next = commandTrie[next].sibling;
+    }
+    if(next != -1 && commandTrie[next].byte == byte)
+    {
+        return next;
+    }
+    if(create == false)
+    {
+        return -1;
+    }
+    if(trieCount == trieCapacity)
+    {
+        trieCapacity *= 2;
+        commandTrie = realloc(commandTrie, trieCapacity * sizeof(struct trieNode));
+    }
+    int added = trieCount++;
+    commandTrie[added].child = -1;
+    commandTrie[added].sibling = next;
+    commandTrie[added].byte = byte;
+    commandTrie[added].terminal = false;
+    if(previous == -1)
+    {
+        commandTrie[node].child = added;
+    }
+    else
+    {
+        commandTrie[previous].sibling = added;
+    }
+    return added;
+}
+
+void refreshCommandTrie(void)
+/***************************************************************************
+*   Description -
+*       Makes sure the command trie matches $PATH. Each directory costs a
+*       stat() (see listDirectory). The trie is only rebuilt when $PATH
+*       changed or a directory had to be read again since the last build.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       None
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    const char *path = getenv("PATH");
+    if(path == NULL)
+    {
+        path = "/bin:/usr/bin";
+    }
+    bool stale = commandTrie == NULL || strcmp(triePath, path) != 0;
+
+    // Two passes over $PATH: check every directory, then build if needed
+    for(int pass = 0; pass < 2; pass++)
+    {
+        if(pass == 1)
+        {
+            if(stale == false)
+            {
+                return;
+            }
+            if(commandTrie == NULL)
+            {
+                trieCapacity = 4096;
+                commandTrie = malloc(trieCapacity * sizeof(struct trieNode));
+            }
+            trieCount = 1;
+            commandTrie[0].child = -1;
+            commandTrie[0].sibling = -1;
+            commandTrie[0].terminal = false;
+            for(size_t x = 0; x < sizeof(builtins) / sizeof(builtins[0]); x++)
+            {
+                int node = 0;
+                for(const char *byte = builtins[x].name; *byte != '\0'; byte++)
+                {
+                    node = trieChild(node, *byte, true);
+                }
+                commandTrie[node].terminal = true;
+            }
+        }
+
+        const char *dir = path;
+        while(true)
+        {
+            const char *end = strchrnul(dir, ':');
+            char directory[end - dir + 2];
+            memcpy(directory, dir, end - dir);
+            directory[end - dir] = '\0';
+            struct dirListing *listing = listDirectory(end == dir ? "." : directory);
+            if(listing != NULL && listing->readAt > trieBuilt)
+            {
+                stale = true;
+            }
+            for(int x = 0; pass == 1 && listing != NULL && x < listing->count; x++)
+            {
+                unsigned char type = listing->types[x];
+                if(type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+                {
+                    continue;
+                }
+                int node = 0;
+                for(const char *byte = listing->names[x]; *byte != '\0'; byte++)
+                {
+                    node = trieChild(node, *byte, true);
+                }
+                commandTrie[node].terminal = true;
+            }
+            if(*end == '\0')
+            {
+                break;
+            }
+            dir = end + 1;
+        }
+    }
+    free(triePath);
+    triePath = strdup(path);
+    trieBuilt = listingReads;
+}
+
+struct completion
+/**************************************************************************
+*   Description -
+*       Candidates for the word being completed. Directories carry a 
+*       trailing '/'.
+*   -----------------------------------------------------------------------
+*    char **names           - malloc'd candidate names
+*    int count              - Number of candidates
+*    int capacity           - Room in names
+*
+***************************************************************************/
+{
+    char **names;
+    int count;
+    int capacity;
+};
+
+void addCandidate(struct completion *found, const char *name, size_t length, bool directory)
+/***************************************************************************
+*   Description -
+*       Adds a copy of name (plus '/' for a directory) to the candidates
+****************************************************************************/
+{
+    if(found->count == found->capacity)
+    {
+        found->capacity = found->capacity == 0 ? 64 : found->capacity * 2;
+        found->names = realloc(found->names, found->capacity * sizeof(char *));
+    }
+    char *copy = malloc(length + 2);
+    memcpy(copy, name, length);
+    if(directory == true)
+    {
+        copy[length++] = '/';
+    }
+    copy[length] = '\0';
+    found->names[found->count++] = copy;
+}
+
+void trieCollect(int node, char *name, size_t depth, struct completion *found)
+/***************************************************************************
+*   Description -
+*       Adds every command name below a trie node, name holds the bytes 
+*       leading to the node
+****************************************************************************/
+{
+    if(commandTrie[node].terminal == true)
+    {
+        addCandidate(found, name, depth, false);
+    }
+    for(int child = commandTrie[node].child; child != -1 && depth < 511; child = commandTrie[child].sibling)
+    {
+        name[depth] = commandTrie[child].byte;
+        trieCollect(child, name, depth + 1, found);
+    }
+}
+
+struct lineEditor
+/**************************************************************************
+*   Description -
+*       Line being edited at a terminal prompt (see editLine)
+*   -----------------------------------------------------------------------
+*    char *text             - The line, not NUL terminated
+*    size_t length          - Bytes in text
+*    size_t capacity        - Room in text
+*    size_t cursor          - Cursor position in text
+*    int historyIndex       - History entry shown, -1 when not browsing
+*    bool searching         - In ^R reverse search (see editorSearch)
+*    char query[256]        - Text searched for
+*    size_t queryLength     - Bytes in query
+*    char *saved            - Line before the search, put back by ^G
+*    size_t savedLength     - Bytes in saved
+*    int savedIndex         - historyIndex before the search
+*
+***************************************************************************/
+{
+    char *text;
+    size_t length;
+    size_t capacity;
+    size_t cursor;
+    int historyIndex;
+    bool searching;
+    char query[256];
+    size_t queryLength;
+    char *saved;
+    size_t savedLength;
+    int savedIndex;
+};
+
+struct lineEditor editor;
+
+void editorInsert(const char *text, size_t length)
+/***************************************************************************
+*   Description -
+*       Inserts text at the cursor and moves the cursor past it
+****************************************************************************/
+{
+    while(editor.length + length > editor.capacity)
     {
-        sleep(1);
-        spawnPid = fork();
-        attempts ++;
-        printf("bash: fork: retry: Resource temporarily unavailable - Attempting to reconnect\n");
-        fflush(stdout);
+        editor.capacity = editor.capacity == 0 ? 256 : editor.capacity * 2;
+        editor.text = realloc(editor.text, editor.capacity);
     }
+    memmove(editor.text + editor.cursor + length, editor.text + editor.cursor, editor.length - editor.cursor);
+    memcpy(editor.text + editor.cursor, text, length);
+    editor.length += length;
+    editor.cursor += length;
+}
 
-    // If fork fails
-    if(spawnPid == -1)
+void editorRedraw(void)
+/***************************************************************************
+*   Description -
+*       Rewrites the prompt line and puts the terminal cursor in place
+****************************************************************************/
+{
+    if(editor.searching == true)
     {
-
-        perror("fork() failed!\n");
-        fflush(stdout);
+        printf("\r(reverse-i-search)`%.*s': %.*s\x1b[K", (int)editor.queryLength, editor.query,
+               (int)editor.length, editor.text);
+    }
+    else
+    {
+        printf("\r: %.*s\x1b[K", (int)editor.length, editor.text);
+    }
+    if(editor.cursor < editor.length)
+    {
+        printf("\x1b[%zuD", editor.length - editor.cursor);
     }
+    fflush(stdout);
+}
 
-    // If fork is sucessful
-    else if(spawnPid == 0)
+void completeWord(void)
+/***************************************************************************
+*   Description -
+*       Tab completion of the word before the cursor. The first word of
+*       a command (or pipeline stage) is completed from the command trie,
+*       anything else, < and > targets included, from the listing of its
+*       directory. A single candidate is inserted whole, several are 
+*       completed to their common prefix, and listed when that adds 
+*       nothing.
+****************************************************************************/
+{
+    size_t start = editor.cursor;
+    while(start > 0 && editor.text[start - 1] != ' ')
     {
-        // Turn off all signal inputs for TSTP for child
-        SIGTSTP_action.sa_handler = SIG_IGN;
-        sigfillset(&SIGTSTP_action.sa_mask);
-        sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+        start --;
+    }
+    size_t previousEnd = start;
+    while(previousEnd > 0 && editor.text[previousEnd - 1] == ' ')
+    {
+        previousEnd --;
+    }
+    size_t previousStart = previousEnd;
+    while(previousStart > 0 && editor.text[previousStart - 1] != ' ')
+    {
+        previousStart --;
+    }
+    const char *word = editor.text + start;
+    size_t wordLength = editor.cursor - start;
+    const char *previous = editor.text + previousStart;
+    size_t previousLength = previousEnd - previousStart;
+    bool commandWord = previousLength == 0 || (previousLength == 1 && previous[0] == '|') ||
+                       (previousStart == 0 && previousLength == 4 && memcmp(previous, "time", 4) == 0);
 
-        // file input and output
-        int sourceFD;
-        int targetFD;
-        if(ourCommand->inputFile != NULL)
+    struct completion found = {0};
+    size_t typed;
+    if(commandWord == true && memchr(word, '/', wordLength) == NULL)
+    {
+        refreshCommandTrie();
+        int node = 0;
+        for(size_t x = 0; x < wordLength && node != -1; x++)
         {
-            sourceFD = open(ourCommand->inputFile, O_RDONLY);
-            if (sourceFD == -1) 
-            { 
-                printf("cannot open %s for input\n", ourCommand->inputFile);
-                exit(1); 
-            }
-
-            // Redirect stdin to source file
-            int result = dup2(sourceFD, 0);
-            if (result == -1) 
-            { 
-                perror("source dup2()"); 
-                exit(2); 
-            }
-            
+            node = trieChild(node, word[x], false);
         }
-
-        if(ourCommand->outputFile != NULL)
+        if(node != -1 && wordLength < 512)
+        {
+            char name[512];
+            memcpy(name, word, wordLength);
+            trieCollect(node, name, wordLength, &found);
+        }
+        typed = wordLength;
+    }
+    else
+    {
+        // Directory part (kept as typed) and the name being completed
+        const char *slash = memrchr(word, '/', wordLength);
+        const char *base = slash != NULL ? slash + 1 : word;
+        typed = word + wordLength - base;
+        char directory[slash != NULL ? slash - word + 2 : 2];
+        if(slash == NULL)
+        {
+            strcpy(directory, ".");
+        }
+        else
         {
-            targetFD = open(ourCommand->outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-            if (targetFD == -1) 
-            { 
-                printf("cannot open %s for output\n", ourCommand->outputFile); 
-                exit(1); 
+            memcpy(directory, word, slash - word + 1);
+            directory[slash - word + 1] = '\0';
+        }
+        struct dirListing *listing = listDirectory(directory);
+        for(int x = 0; listing != NULL && x < listing->count; x++)
+        {
+            const char *name = listing->names[x];
+            if(strncmp(name, base, typed) != 0 || (name[0] == '.' && (typed == 0 || base[0] != '.')))
+            {
+                continue;
             }
-        
-            // Redirect stdout to target file
-            int result = dup2(targetFD, 1);
-            if (result == -1) 
-            { 
-                perror("target dup2()"); 
-                exit(1); 
+            bool isDirectory = listing->types[x] == DT_DIR;
+            if(listing->types[x] == DT_LNK || listing->types[x] == DT_UNKNOWN)
+            {
+                char full[strlen(directory) + strlen(name) + 2];
+                sprintf(full, "%s/%s", directory, name);
+                struct stat info;
+                isDirectory = stat(full, &info) == 0 && S_ISDIR(info.st_mode);
             }
+            addCandidate(&found, name, strlen(name), isDirectory);
         }
+    }
 
-        // Check background status
-        if(ourCommand->backGround == false)
+    if(found.count == 0)
+    {
+        printf("\a");
+    }
+    else if(found.count == 1)
+    {
+        size_t length = strlen(found.names[0]);
+        editorInsert(found.names[0] + typed, length - typed);
+        if(found.names[0][length - 1] != '/')
         {
-            SIGINT_action.sa_handler = SIG_DFL;
-            sigfillset(&SIGINT_action.sa_mask);
-            sigaction(SIGINT, &SIGINT_action, NULL);
+            editorInsert(" ", 1);
         }
-
-        // Execute command
-        execvp(*arguement[0], *arguement);
-        printf("no such file or directory\n");
-        exit(1);
     }
-
-    // Parent
     else
-    {   
-        //Background process, continue as normal
-        if (ourCommand->backGround == true && foregroundOnlymode == 0)
+    {
+        size_t common = strlen(found.names[0]);
+        for(int x = 1; x < found.count; x++)
         {
-            // Add background process to LL
-            while(process->next != NULL)
+            size_t y = 0;
+            while(y < common && found.names[x][y] == found.names[0][y])
             {
-                process = process->next;
+                y ++;
             }
-            struct process *newProcess = malloc(sizeof(struct process));
-            newProcess->pid = spawnPid;
-            newProcess->next = NULL;
-            newProcess->prev = process;
-            process->next = newProcess;
-            printf("background pid is %d\n", newProcess->pid);
-            fflush(stdout);
-
-            spawnPid = waitpid(spawnPid, &childStatus, WNOHANG);
-
+            common = y;
+        }
+        if(common > typed)
+        {
+            editorInsert(found.names[0] + typed, common - typed);
+        }
+        else if(found.count > 200)
+        {
+            printf("\n%d possibilities\n", found.count);
         }
-        // Foreground process, wait on execution
         else
         {
-            spawnPid = waitpid(spawnPid, &childStatus, 0);
-            if(WIFEXITED(childStatus) != 1)
+            qsort(found.names, found.count, sizeof(char *), compareNames);
+            size_t column = 0;
+            printf("\n");
+            for(int x = 0; x < found.count; x++)
             {
-                printf("terminated by signal %d\n",  WTERMSIG(childStatus));
-                fflush(stdout);
+                size_t length = strlen(found.names[x]);
+                if(column > 0 && column + length + 2 > 80)
+                {
+                    printf("\n");
+                    column = 0;
+                }
+                printf("%s  ", found.names[x]);
+                column += length + 2;
             }
-            *FGS = WEXITSTATUS(childStatus);
+            printf("\n");
         }
+    }
+    for(int x = 0; x < found.count; x++)
+    {
+        free(found.names[x]);
+    }
+    free(found.names);
+}
+
+void editorHistory(int direction)
+/***************************************************************************
+*   Description -
+*       Up and down arrows: replaces the line with the previous or next 
+*       history entry, past the newest entry the line is emptied
+****************************************************************************/
+{
+    if(syncHistory() == false)
+    {
+        return;
+    }
+    int index = editor.historyIndex == -1 ? commandHistory.count : editor.historyIndex;
+    index += direction;
+    if(index < 0)
+    {
+        return;
+    }
+    editor.length = 0;
+    editor.cursor = 0;
+    if(index >= commandHistory.count)
+    {
+        editor.historyIndex = -1;
+        return;
+    }
+    editor.historyIndex = index;
+    const char *line;
+    size_t length = historyEntry(index, &line);
+    editorInsert(line, length);
+}
 
+void editorSearch(char key)
+/***************************************************************************
+*   Description -
+*       ^R reverse search. The first ^R starts it, typed text narrows it
+*       to the newest entry containing the query and another ^R moves on
+*       to the next older one. Backspace shortens the query and searches
+*       again from the newest entry, ^G puts back the line from before
+*       the search. A query with no match is not extended.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       char key                - Key read while searching, or the ^R
+*                                 that starts the search
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      None
+****************************************************************************/
+{
+    if(editor.searching == false)
+    {
+        editor.saved = realloc(editor.saved, editor.length + 1);
+        memcpy(editor.saved, editor.text, editor.length);
+        editor.savedLength = editor.length;
+        editor.savedIndex = editor.historyIndex;
+        editor.queryLength = 0;
+        editor.searching = true;
+        return;
+    }
+    if(key == 7)    // ^G
+    {
+        editor.length = 0;
+        editor.cursor = 0;
+        editorInsert(editor.saved, editor.savedLength);
+        editor.historyIndex = editor.savedIndex;
+        editor.searching = false;
+        return;
+    }
+    if(syncHistory() == false)
+    {
+        printf("\a");
+        return;
+    }
+    // The entry shown may still match a longer query, ^R wants an older one
+    int before = editor.historyIndex == -1 ? commandHistory.count : editor.historyIndex + 1;
+    size_t queryLength = editor.queryLength;
+    if(key == 18)   // ^R
+    {
+        before -= editor.historyIndex != -1;
+    }
+    else if(key == 127 || key == 8)
+    {
+        queryLength -= queryLength > 0;
+        before = commandHistory.count;
+    }
+    else if(queryLength < sizeof(editor.query))
+    {
+        editor.query[queryLength++] = key;
+    }
+    if(queryLength == 0)
+    {
+        editor.queryLength = 0;
+        return;
+    }
+    // Like readline, ^R skips entries that repeat the line shown
+    const char *line;
+    size_t length;
+    int index = before;
+    do
+    {
+        index = findHistoryText(editor.query, queryLength, index);
+        length = index == -1 ? 0 : historyEntry(index, &line);
+    }
+    while(key == 18 && index != -1 && length == editor.length && memcmp(line, editor.text, length) == 0);
+    if(index == -1)
+    {
+        printf("\a");
+        return;
     }
+    editor.queryLength = queryLength;
+    editor.historyIndex = index;
+    editor.length = 0;
+    editor.cursor = 0;
+    editorInsert(line, length);
+    editor.cursor = (const char *)memmem(line, length, editor.query, queryLength) - line;
 }
 
+bool editLine(int fd, const char **line, size_t *length)
+/***************************************************************************
+*   Description -
+*       Reads a line from the terminal with editing: arrows, home/end, 
+*       backspace/delete, ^A ^E ^U ^K ^L, up/down through history, ^R 
+*       reverse search and Tab completion. The terminal is in raw mode only while editing, 
+*       signals stay enabled so ^C and ^Z behave as before. Keys are read
+*       as the event loop finds them, finished background processes and
+*       ^Z are reported as they happen and the line is redrawn after them.
+*
+*   -----------------------------------------------------------------------
+*   Param - 
+*       int fd                  - Terminal
+*       const char **line       - Set to the line, valid until the next call
+*       size_t *length          - Set to its length
+*
+*   -----------------------------------------------------------------------
+*   Returns
+*      bool                     - false at end of input (^D on empty line)
+****************************************************************************/
+{
+    struct termios saved;
+    tcgetattr(fd, &saved);
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSADRAIN, &raw);
+
+    editor.length = 0;
+    editor.cursor = 0;
+    editor.historyIndex = -1;
+    editor.searching = false;
+    bool done = false;
+    bool ended = false;
+    while(done == false)
+    {
+        waitForInput(fd, editorRedraw);
+
+        char key;
+        if(read(fd, &key, 1) != 1)
+        {
+            ended = true;
+            break;
+        }
+        // Any other key ends the search, keeping the match to edit or run
+        if(editor.searching == true)
+        {
+            if(key == 18 || key == 7 || key == 127 || key == 8 || (unsigned char)key >= 32)
+            {
+                editorSearch(key);
+                editorRedraw();
+                continue;
+            }
+            editor.searching = false;
+            editorRedraw();
+        }
+        switch(key)
+        {
+            case '\r':
+            case '\n':
+                done = true;
+                break;
+            case 4:     // ^D
+                if(editor.length == 0)
+                {
+                    ended = true;
+                    done = true;
+                }
+                else if(editor.cursor < editor.length)
+                {
+                    memmove(editor.text + editor.cursor, editor.text + editor.cursor + 1, editor.length - editor.cursor - 1);
+                    editor.length --;
+                }
+                break;
+            case 127:   // Backspace
+            case 8:
+                if(editor.cursor > 0)
+                {
+                    memmove(editor.text + editor.cursor - 1, editor.text + editor.cursor, editor.length - editor.cursor);
+                    editor.cursor --;
+                    editor.length --;
+                }
+                break;
+            case '\t':
+                completeWord();
+                break;
+            case 1:     // ^A
+                editor.cursor = 0;
+                break;
+            case 5:     // ^E
+                editor.cursor = editor.length;
+                break;
+            case 21:    // ^U
+                memmove(editor.text, editor.text + editor.cursor, editor.length - editor.cursor);
+                editor.length -= editor.cursor;
+                editor.cursor = 0;
+                break;
+            case 11:    // ^K
+                editor.length = editor.cursor;
+                break;
+            case 12:    // ^L
+                printf("\x1b[H\x1b[2J");
+                break;
+            case 18:    // ^R
+                editorSearch(key);
+                break;
+            case 27:    // Escape sequence, arrows and friends
+            {
+                char sequence[3] = {0};
+                if(read(fd, &sequence[0], 1) != 1 || (sequence[0] != '[' && sequence[0] != 'O') ||
+                   read(fd, &sequence[1], 1) != 1)
+                {
+                    break;
+                }
+                if(sequence[1] >= '0' && sequence[1] <= '9')
+                {
+                    read(fd, &sequence[2], 1);
+                }
+                switch(sequence[1])
+                {
+                    case 'A':
+                        editorHistory(-1);
+                        break;
+                    case 'B':
+                        editorHistory(1);
+                        break;
+                    case 'C':
+                        editor.cursor += editor.cursor < editor.length;
+                        break;
+                    case 'D':
+                        editor.cursor -= editor.cursor > 0;
+                        break;
+                    case 'H':
+                        editor.cursor = 0;
+                        break;
+                    case 'F':
+                        editor.cursor = editor.length;
+                        break;
+                    case '3':   // Delete
+                        if(editor.cursor < editor.length)
+                        {
+                            memmove(editor.text + editor.cursor, editor.text + editor.cursor + 1, editor.length - editor.cursor - 1);
+                            editor.length --;
+                        }
+                        break;
+                }
+                break;
+            }
+            default:
+                if((unsigned char)key >= 32)
+                {
+                    editorInsert(&key, 1);
+                }
+                break;
+        }
+        if(done == false)
+        {
+            editorRedraw();
+        }
+    }
+
+    printf("\n");
+    fflush(stdout);
+    tcsetattr(fd, TCSADRAIN, &saved);
+    *line = editor.text;
+    *length = editor.length;
+    return ended == false;
+}
 
-int main(void){ 
+int main(int argc, char *argv[]){ 
 /***************************************************************************
 *   Description -
 *       Init    
-*           Set sigaction for SIGINT
-*           Set sigaction for SIGTSTP
-*           Create buffer for user command
-*           Create process structure node and add main process to front
+*           Ignore SIGINT and SIGTSTP, block them and SIGCHLD
+*           Create the event loop (epoll) and its signalfd
+*           Open the input (script or stdin), pick interactive or batch mode
+*           or serve clients on a socket instead (--serve PATH)
 *           Init foreground (exit) status
 *       Loop
-*           Clear buffer
-*           Get User input
-*           Set SIGTSTP to ignore
-*           Set up buffer expansion and send to dollaDollaParse
-*           Create command structre with user input
-*           Clear all zombie processes
+*           Reset the line arena
+*           Report finished background processes and ^Z (signalfd driven)
+*           Get User input, reporting background processes as they finish
+*               (interactive only: prompt and flush)
+*           Create command structre with user input ($$ expanded)
 *           Execute command depending on type (blank/comment, built in, other)
-*           Set SIGTSTP to handler
-*           Set SIGINT to ignore
-*           Free pointer
-*       On Exit
-*           free processMain
-*           free buffer
+*       On Exit (exit or end of input)
+*           free line arena
+*           flush output
 *
 *   -----------------------------------------------------------------------
 *   Param - 
-*       None
+*       int argc, char *argv[]  - smallsh [-i] [script] or 
+*                                 smallsh --serve PATH (serveClients())
 *   -----------------------------------------------------------------------
 *   Returns
 *       None
 ****************************************************************************/
 
-    //Set sigaction for SIGINT
+    // SIGINT and SIGTSTP are ignored, so children inherit that (foreground
+    // children restore SIGINT). The shell itself reads them, and SIGCHLD,
+    // from a signalfd in the event loop, so they stay blocked
     struct sigaction SIGINT_action = {{0}};
     SIGINT_action.sa_handler = SIG_IGN;
     sigfillset(&SIGINT_action.sa_mask);
     SIGINT_action.sa_flags = SA_RESTART;
     sigaction(SIGINT, &SIGINT_action, NULL);
-
-    //Set sigaction for SIGTSTP
-    struct sigaction SIGTSTP_action = {{0}};
-    SIGTSTP_action.sa_handler = handle__SIGTSTP;
-    sigfillset(&SIGTSTP_action.sa_mask);
-    SIGTSTP_action.sa_flags = SA_RESTART;
+    struct sigaction SIGTSTP_action = SIGINT_action;
     sigaction(SIGTSTP, &SIGTSTP_action, NULL);
 
-    //Create buffer for user command
-    size_t len = 2048;
-    char *buffer = malloc(len * sizeof(char));
-    size_t input;
+    // Jobs run in process groups of their own and fg hands them the
+    // terminal, taking it back from the background needs SIGTTOU ignored
+    sigaction(SIGTTOU, &SIGINT_action, NULL);
+
+    // Processes orphaned by our jobs are re-parented to the shell, so exit
+    // can reap whole process groups and the reaper clears them otherwise
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    sigemptyset(&shellSignals);
+    sigaddset(&shellSignals, SIGCHLD);
+    sigaddset(&shellSignals, SIGINT);
+    sigaddset(&shellSignals, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &shellSignals, NULL);
+    eventFD = epoll_create1(EPOLL_CLOEXEC);
+    signalSource.fd = signalfd(-1, &shellSignals, SFD_CLOEXEC | SFD_NONBLOCK);
+    if(eventFD == -1 || signalSource.fd == -1 || watchEvents(&signalSource, EPOLLIN) == false)
+    {
+        perror("smallsh: event loop");
+        return 1;
+    }
+
+    // Input is a script (smallsh script.sh) or stdin. -i forces prompting
+    // when stdin is not a terminal
+    int inputFD = STDIN_FILENO;
+    bool forceInteractive = false;
+    const char *servePath = NULL;
+    for(int x = 1; x < argc; x++)
+    {
+        if(strcmp(argv[x], "-i") == 0)
+        {
+            forceInteractive = true;
+        }
+        else if(strcmp(argv[x], "--serve") == 0 && x + 1 < argc)
+        {
+            servePath = argv[++x];
+        }
+        else
+        {
+            inputFD = open(argv[x], O_RDONLY | O_CLOEXEC);
+            if(inputFD == -1)
+            {
+                perror(argv[x]);
+                return 1;
+            }
+            break;
+        }
+    }
+    interactive = servePath == NULL && (forceInteractive == true || (inputFD == STDIN_FILENO && isatty(STDIN_FILENO)));
+    lineEditing = interactive == true && inputFD == STDIN_FILENO && isatty(STDIN_FILENO);
+    openReader(&inputReader, inputFD);
+
+    // Batch mode: no prompts, output goes out in large blocks
+    if(interactive == false)
+    {
+        setvbuf(stdout, NULL, _IOFBF, 65536);
+    }
+
+    // Audit log from the start, for scripts and batch runs
+    const char *auditPath = getenv("SMALLSH_AUDIT");
+    if(auditPath != NULL && auditPath[0] != '\0' && auditOpen(auditPath) == false)
+    {
+        perror(auditPath);
+    }
+
+    // $$ expands to this for the life of the shell
+    pidLength = snprintf(pidString, sizeof(pidString), "%d", getpid());
+
+    // Server mode takes its lines from clients, not the input
+    if(servePath != NULL)
+    {
+        int result = serveClients(servePath, SIGINT_action, SIGTSTP_action);
+        auditClose();
+        fflush(stdout);
+        return result;
+    }
 
-    //Create process structure node and add main process to front
-    struct process *processMain = malloc(sizeof(struct process));
-    processMain->pid = getpid();
-    processMain->next = NULL;
+    // Only interactive shells keep history
+    if(interactive == true)
+    {
+        openHistory();
+    }
 
     // Init foreground (exit) status
     int FGS = 0;
+
+    // Everything parsed from a line lives here until the next line
+    struct arena lineArena = {0};
+    unsigned int linesRead = 0;
     
     do
     {   
-        //Clear buffer
-        for (int x = 0; x < 2048; x++)
+        // Release the previous line's command
+        arenaReset(&lineArena);
+
+        // Signals that came in while lines were read from a buffer. Each
+        // line checks while jobs run, otherwise every 64th is enough
+        if(jobsRunning > 0 || (linesRead++ & 63) == 0)
         {
-            buffer[x] = '\0';
+            readSignals(&signalSource, EPOLLIN);
         }
 
-        // Get User input
-        printf(": ");
-        fflush(stdout);
-        input = getline(&buffer, &len, stdin);
-
-        // Set up buffer expansion and send to dollaDollaParse
-        int size = (int) input;
-        if (size == 1)
+        // Lines from background jobs, the prompt handles them while idle
+        if(jobOutputs != NULL)
         {
-           continue;
+            runEvents(0);
         }
-        buffer[size] = '\0';
-        buffer[strcspn(buffer, "\n")] = 0;
-        buffer = dollaDollaParse(buffer);
 
-        // Create command structre with user input
-        struct command *ourCommand = parseBuffer(buffer);
-        fflush(stdin);
+        // Report finished background processes and ^Z
+        reapProcesses(false);
+        reportStops();
+
+        // Get User input
+        if(interactive == true)
+        {
+            printPrompt();
+            if(lineEditing == false && lineBuffered(&inputReader) == false)
+            {
+                waitForInput(inputReader.fd, printPrompt);
+            }
+        }
+        const char *buffer;
+        size_t size;
+        bool haveLine = lineEditing == true ? editLine(inputReader.fd, &buffer, &size) :
+                                              readLine(&inputReader, &buffer, &size);
+        if(haveLine == false)
+        {
+            // End of input behaves like exit
+            if(interactive == true && lineEditing == false)
+            {
+                printf("\n");
+            }
+            exitProcess();
+            break;
+        }
 
-        // Clear all zombie processes
-        struct process *pointer = malloc(sizeof(struct process));
-        pointer = processMain->next;
-        while(pointer != NULL)
+        // Interactive lines go to the history, !event lines are replaced
+        // by the entry they name first
+        if(interactive == true && commandHistory.fd != -1)
         {
-            int childStatus;
-            int PID = waitpid(pointer->pid, &childStatus, WNOHANG);
-            if(PID == pointer->pid)
+            const char *start = buffer;
+            while(start < buffer + size && *start == ' ')
             {
-                if(WIFEXITED(childStatus))
-                {
-                    printf("Child %d exited normally with status %d\n", pointer->pid, WEXITSTATUS(childStatus));
-                } else
-                {
-                    printf("Child %d exited abnormally due to signal %d\n", pointer->pid, WTERMSIG(childStatus));
-                }
-                fflush(stdout);
-                pointer->prev->next = pointer->next;
-                if(pointer->next != NULL)
+                start ++;
+            }
+            if(start < buffer + size && *start == '!')
+            {
+                size -= start - buffer;
+                buffer = start;
+                if(expandHistory(&buffer, &size) == false)
                 {
-                    pointer->next->prev = pointer->prev;    
+                    continue;
                 }
+                start = buffer;
+            }
+            if(start < buffer + size && *start != '#')
+            {
+                addHistory(buffer, size);
             }
-            pointer = pointer->next;
         }
-        
-        // Execute command depending on type
-        if(strcmp(ourCommand->commandType,"Blank") == 0)
+
+        // Create command structre with user input, $$ expanded as it tokenizes.
+        // Repeated lines come from the cache and are shared, never modified
+        struct command *ourCommand = cachedParse(buffer, size, &lineArena);
+
+        // $(command) words are run and replaced by their output, patterns
+        // by the paths they match
+        ourCommand = expandCommand(ourCommand, &lineArena, SIGINT_action, SIGTSTP_action);
+        if(ourCommand == NULL)
         {
+            FGS = 1;
             continue;
         }
-        // Built in
-        else if (strcmp(ourCommand->commandType,"exit") == 0)
+
+        // Execute command depending on type
+        if(executeLine(ourCommand, &FGS, SIGINT_action, SIGTSTP_action) == false)
         {
-            exitProcess(processMain);
+            exitProcess();
             break;
         }
-        // Built in
-        else if (strcmp(ourCommand->commandType,"cd") == 0)
-        {
-            cdProcess(ourCommand);
-        }
-        // Built in
-        else if (strcmp(ourCommand->commandType,"status") == 0)
-        {
-            statusProcess(&FGS);
-        }
-        // All other cases
-        else
+        if(interactive == true)
         {
-            otherProcess(ourCommand, processMain, &FGS, SIGINT_action, SIGTSTP_action);
+            fflush(stdout);
         }
-
-        // Set SIGINT to ignore
-        SIGINT_action.sa_handler = SIG_IGN;
-        sigfillset(&SIGINT_action.sa_mask);
-        sigaction(SIGINT, &SIGINT_action, NULL);
-
-        free(pointer);
-        fflush(stdout);
     } while (true);
 
-    free(processMain);
-    free(buffer);
+    auditClose();
+    free(lineArena.block);
+    fflush(stdout);
     return 0;
 }
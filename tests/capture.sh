@@ -0,0 +1,39 @@
+#!/bin/bash
+# $(command) capture. Built ins print straight into the capture, so output
+# larger than any pipe comes back whole instead of hanging the shell.
+#
+#   tests/capture.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+FAILED=0
+
+expect() {
+    local name=$1 want=$2 got
+    got=$(timeout 20 "$SMALLSH" "$SCRIPT" 2>&1)
+    if [ $? -eq 124 ]; then
+        echo "FAIL $name: timed out"
+        FAILED=1
+    elif [ "$got" != "$want" ]; then
+        echo "FAIL $name: got '${got:0:200}'"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+# A 2MB word echoed by the native echo, more than a pipe holds
+WORD=$(head -c 2000000 /dev/zero | tr '\0' x)
+printf 'echo $(echo %s) | wc -c\n' "$WORD" > "$SCRIPT"
+expect "large built in output" 2000001
+
+printf 'echo [$(echo a b | cat)] [$(/bin/echo ext)] [$(echo x$(echo y))]\n' > "$SCRIPT"
+expect "pipelines, external and nested" "[a b] [ext] [xy]"
+
+OUT=$(mktemp)
+printf 'echo [$(echo file > %s)]\ncat %s\n' "$OUT" "$OUT" > "$SCRIPT"
+expect "redirected built in" "$(printf '[]\nfile')"
+rm -f "$OUT"
+
+exit $FAILED
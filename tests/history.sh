@@ -0,0 +1,51 @@
+#!/bin/bash
+# History at a terminal. ^R finds the newest entry containing the query
+# and older ones after it, ^G puts back the line, history -s lists every
+# entry containing its text.
+#
+#   tests/history.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+HISTORY=$(mktemp)
+trap 'rm -f "$HISTORY"' EXIT
+printf 'echo alpha one\necho beta two\necho alpha three\n' > "$HISTORY"
+
+timeout 20 python3 - "$SMALLSH" "$HISTORY" <<'PYTHON'
+import os, pty, select, sys
+
+pid, terminal = pty.fork()
+if pid == 0:
+    os.environ['HISTFILE'] = sys.argv[2]
+    os.execv(sys.argv[1], [sys.argv[1]])
+
+def send(keys):
+    os.write(terminal, keys)
+    output = b''
+    while select.select([terminal], [], [], 0.5)[0]:
+        try:
+            data = os.read(terminal, 4096)
+        except OSError:
+            break
+        if not data:
+            break
+        output += data
+    return output
+
+failed = False
+def expect(name, got, want):
+    global failed
+    if want in got:
+        print('ok   ' + name)
+    else:
+        print('FAIL %s: got %r' % (name, got[-200:]))
+        failed = True
+
+send(b'')
+expect('^R finds the newest match', send(b'\x12alpha\r'), b'\r\nalpha three\r\n')
+expect('^R again finds an older one', send(b'\x12alpha\x12\r'), b'\r\nalpha one\r\n')
+expect('^G puts the line back', send(b'/bin/echo kept\x12beta\x07\r'), b'\r\nkept\r\n')
+expect('history -s', send(b'history -s alpha\r'),
+       b'    1  echo alpha one\r\n    3  echo alpha three\r\n    4  echo alpha three\r\n    5  echo alpha one\r\n    7  history -s alpha\r\n')
+send(b'exit\r')
+sys.exit(1 if failed else 0)
+PYTHON
@@ -0,0 +1,61 @@
+#!/bin/bash
+# parallel and dag lines. Native built ins (echo, true, ...) run as the
+# real utility, shell built ins and $(command) are refused.
+#
+#   tests/parallel.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+SCRIPT=$(mktemp)
+LINES=$(mktemp)
+trap 'rm -f "$SCRIPT" "$LINES"' EXIT
+FAILED=0
+
+expect() {
+    local name=$1 want=$2 got
+    got=$(timeout 20 "$SMALLSH" "$SCRIPT" 2>&1)
+    if [ "$got" != "$want" ]; then
+        echo "FAIL $name: got '${got:0:200}'"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+printf 'echo hi\ntrue\n' > "$LINES"
+printf 'parallel -j 2 %s\nstatus\n' "$LINES" > "$SCRIPT"
+expect "native built ins in parallel" "$(printf 'hi\nexit value 0')"
+
+printf 'cd /\n' > "$LINES"
+printf 'parallel %s\nstatus\n' "$LINES" > "$SCRIPT"
+expect "shell built ins in parallel" "$(printf 'parallel: line 1: only external commands can run\nexit value 1')"
+
+printf 'sleep 5\ntrue\n' > "$LINES"
+printf 'timeout -d 1\nparallel -j 2 %s\nstatus\ntimeout -d 0\ntimeout 1 parallel %s\nstatus\n' "$LINES" "$LINES" > "$SCRIPT"
+line='parallel: line 1 timed out after 1s, status 124'
+expect "time limit in parallel" "$(printf '%s\nexit value 1\n%s\nexit value 1' "$line" "$line")"
+
+printf 'a: sleep 5\nb a: true\n' > "$LINES"
+printf 'timeout 1 dag %s\nstatus\n' "$LINES" > "$SCRIPT"
+got=$(timeout 20 "$SMALLSH" "$SCRIPT" 2>&1)
+if grep -q '^dag: a timed out after 1s, status 124, skipping 1 tasks$' <<< "$got" &&
+   [ "$(tail -n 1 <<< "$got")" = "exit value 1" ]; then
+    echo "ok   time limit in dag"
+else
+    echo "FAIL time limit in dag: got '$got'"
+    FAILED=1
+fi
+
+printf '/bin/echo $(echo sub)\n' > "$LINES"
+printf 'parallel %s\nstatus\n' "$LINES" > "$SCRIPT"
+expect "substitution in parallel" "$(printf 'parallel: line 1: $(command) is not supported\nexit value 1')"
+
+printf 'a: /bin/echo $(echo sub)\n' > "$LINES"
+printf 'dag %s\n' "$LINES" > "$SCRIPT"
+if timeout 20 "$SMALLSH" "$SCRIPT" 2>&1 | grep -q '^dag: a: $(command) is not supported$'; then
+    echo "ok   substitution in dag"
+else
+    echo "FAIL substitution in dag"
+    FAILED=1
+fi
+
+exit $FAILED
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Pipelines with built in stages. A built in writing more than a pipe 
+# holds to another built in must not block the shell.
+#
+#   tests/pipeline.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+FAILED=0
+
+expect() {
+    local name=$1 want=$2 got
+    got=$(timeout 20 "$SMALLSH" "$SCRIPT" 2>&1)
+    if [ $? -eq 124 ]; then
+        echo "FAIL $name: timed out"
+        FAILED=1
+    elif [ "$got" != "$want" ]; then
+        echo "FAIL $name: got '${got:0:200}'"
+        FAILED=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+WORD=$(head -c 2000000 /dev/zero | tr '\0' x)
+printf 'echo %s | true\nstatus\n' "$WORD" > "$SCRIPT"
+expect "large built in into built in" "exit value 0"
+
+printf 'echo %s | echo done\n' "$WORD" > "$SCRIPT"
+expect "large built in into echo" "done"
+
+printf 'echo %s | wc -c\n' "$WORD" > "$SCRIPT"
+expect "large built in into external" "2000001"
+
+printf 'echo %s | nosuchcommand\nstatus\n' "$WORD" > "$SCRIPT"
+expect "large built in into missing command" "$(printf 'no such file or directory\nexit value 1')"
+
+exit $FAILED
@@ -0,0 +1,66 @@
+#!/bin/bash
+# --serve mode. One client captures a built in's output larger than any
+# pipe, a second client must still be answered afterwards.
+#
+#   tests/serve.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+SOCKET=$(mktemp -u /tmp/serve.XXXXXX)
+"$SMALLSH" --serve "$SOCKET" > /dev/null 2>&1 &
+SERVER=$!
+trap 'rm -f "$SOCKET"' EXIT
+for ((x = 0; x < 50; x++)); do
+    [ -S "$SOCKET" ] && break
+    sleep 0.1
+done
+
+timeout 20 python3 - "$SOCKET" <<'PYTHON'
+import socket, sys
+
+def connect():
+    client = socket.socket(socket.AF_UNIX)
+    client.connect(sys.argv[1])
+    return client.makefile('rwb')
+
+def send(client, line):
+    client.write(line.encode() + b'\n')
+    client.flush()
+    reply = client.readline()
+    output = b''
+    if reply.startswith(b'output '):
+        output = client.read(int(reply.split()[1]))
+        reply = client.readline()
+    return reply.decode().strip(), output
+
+failed = False
+def expect(name, got, want):
+    global failed
+    if got == want:
+        print('ok   ' + name)
+    else:
+        print('FAIL %s: got %r' % (name, got[:200]))
+        failed = True
+
+first = connect()
+expect('capture on', send(first, '%capture on'), ('status 0', b''))
+word = 'x' * 2000000
+status, output = send(first, 'echo ' + word)
+expect('large captured output', (status, len(output)), ('status 0', len(word) + 1))
+expect('small captured output', send(first, 'echo hi'), ('status 0', b'hi\n'))
+
+second = connect()
+expect('second client', send(second, 'status'), ('status 0', b''))
+sys.exit(1 if failed else 0)
+PYTHON
+STATUS=$?
+[ $STATUS -eq 124 ] && echo "FAIL server stopped answering"
+
+# A wedged server ignores SIGTERM, so fall back to SIGKILL
+kill -TERM $SERVER
+for ((x = 0; x < 50; x++)); do
+    kill -0 $SERVER 2> /dev/null || break
+    sleep 0.1
+done
+kill -KILL $SERVER 2> /dev/null && STATUS=1
+wait $SERVER 2> /dev/null
+exit $STATUS
@@ -0,0 +1,44 @@
+#!/bin/bash
+# timeout prefix. The limit reaches everything the command started, not
+# only the process the shell launched.
+#
+#   tests/timeout.sh [smallsh]
+
+SMALLSH=${1:-./smallsh}
+SCRIPT=$(mktemp)
+CHILD=$(mktemp)
+OUT=$(mktemp)
+trap 'rm -f "$SCRIPT" "$CHILD" "$OUT"; pkill -f "^sleep 97.5" 2> /dev/null' EXIT
+FAILED=0
+
+# sh waits on a sleep the shell never sees
+printf 'sleep 97.5\n' > "$CHILD"
+printf 'timeout 1 sh %s\nstatus\ntimeout 1 sh %s | cat\nstatus\n' "$CHILD" "$CHILD" > "$SCRIPT"
+want=$(printf 'timed out after 1s (signal 15)\nexit value 124 (timed out)\n%.0s' 1 2)
+# Into a file, a sleep left behind would hold a pipe open for its life
+timeout 20 "$SMALLSH" "$SCRIPT" > "$OUT" 2>&1
+got=$(cat "$OUT")
+sleep 0.2
+if [ "$got" != "$want" ]; then
+    echo "FAIL timeout status: got '$got'"
+    FAILED=1
+elif pgrep -f "^sleep 97.5" > /dev/null; then
+    echo "FAIL timeout left the command's children running"
+    FAILED=1
+else
+    echo "ok   timeout kills the whole command"
+fi
+
+# Prefixes in any order, and a malformed timeout -d fails
+printf 'cpus 0 timeout 1 sleep 5\nstatus\ntimeout 1 cpus 0 /bin/echo hi\ntimeout -d\nstatus\n' > "$SCRIPT"
+want=$(printf 'timed out after 1s (signal 15)\nexit value 124 (timed out)\nhi\ntimeout: usage: timeout -d DURATION [-k GRACE]\nexit value 1')
+timeout 20 "$SMALLSH" "$SCRIPT" > "$OUT" 2>&1
+got=$(cat "$OUT")
+if [ "$got" != "$want" ]; then
+    echo "FAIL prefix order: got '$got'"
+    FAILED=1
+else
+    echo "ok   prefixes in any order"
+fi
+
+exit $FAILED